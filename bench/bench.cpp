@@ -0,0 +1,235 @@
+#include "bench.h"
+#include "io/async/fs/fs_manager_interface.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <unistd.h>
+
+
+namespace cynny {
+namespace cynnypp {
+namespace bench {
+
+namespace {
+
+struct Entry {
+    std::string name;
+    Benchmark benchmark;
+};
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    std::chrono::nanoseconds elapsed;
+    uint64_t bytes;
+    std::string error;
+};
+
+std::vector<Entry>& registry()
+{
+    static std::vector<Entry> entries;
+    return entries;
+}
+
+// removes the temporary directory when the program exits
+struct TemporaryDirectory {
+    TemporaryDirectory()
+        : path{(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("cynnypp-bench-%%%%-%%%%")).native()}
+    {
+        boost::filesystem::create_directories(path);
+    }
+    ~TemporaryDirectory()
+    {
+        boost::system::error_code ec;
+        boost::filesystem::remove_all(path, ec);
+    }
+    std::string path;
+};
+
+/*
+ * Run a benchmark with a growing number of iterations, until they take at least min_time;
+ * the last run is the one reported.
+ */
+Result measure(const Entry& e, std::chrono::nanoseconds min_time)
+{
+    Result r{e.name, 1, std::chrono::nanoseconds{0}, 0, {}};
+    try {
+        while(true) {
+            Run run{r.iterations};
+            e.benchmark(run);
+            r.elapsed = run.elapsed();
+            r.bytes = run.bytes();
+            if(r.elapsed >= min_time || r.iterations >= 1000000000)
+                break;
+
+            // aim a bit beyond min_time, growing at most 10 times per run
+            auto elapsed = std::max<int64_t>(r.elapsed.count(), 1);
+            auto next = r.iterations * 1.4 * min_time.count() / elapsed;
+            r.iterations = std::max<uint64_t>(r.iterations + 1, std::min<uint64_t>(next, r.iterations * 10));
+        }
+    }
+    catch(const filesystem::ErrorCode& ec) {
+        r.error = ec.what();
+    }
+    catch(const std::exception& ex) {
+        r.error = ex.what();
+    }
+    return r;
+}
+
+std::string json_escape(const std::string& s)
+{
+    std::ostringstream out;
+    for(auto c : s) {
+        if(c == '"' || c == '\\')
+            out << '\\' << c;
+        else if(static_cast<unsigned char>(c) < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+        else
+            out << c;
+    }
+    return out.str();
+}
+
+double per_second(uint64_t n, std::chrono::nanoseconds elapsed)
+{
+    return elapsed.count() ? n * 1e9 / elapsed.count() : 0;
+}
+
+void write_json(std::ostream& out, const std::vector<Result>& results)
+{
+    char host[256] = {};
+    gethostname(host, sizeof(host) - 1);
+    char date[32] = {};
+    auto now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+    out << "{\n"
+        << "  \"context\": {\"date\": \"" << date << "\", \"host\": \"" << json_escape(host)
+        << "\", \"compiler\": \"" << json_escape(__VERSION__) << "\"},\n"
+        << "  \"benchmarks\": [";
+    bool first = true;
+    for(auto& r : results) {
+        out << (first ? "\n" : ",\n") << "    {\"name\": \"" << json_escape(r.name) << "\"";
+        first = false;
+        if(!r.error.empty()) {
+            out << ", \"error\": \"" << json_escape(r.error) << "\"}";
+            continue;
+        }
+        out << std::fixed << std::setprecision(3)
+            << ", \"iterations\": " << r.iterations
+            << ", \"real_time_ns\": " << r.elapsed.count()
+            << ", \"ns_per_op\": " << double(r.elapsed.count()) / r.iterations
+            << ", \"ops_per_second\": " << per_second(r.iterations, r.elapsed)
+            << ", \"bytes_per_second\": " << per_second(r.bytes, r.elapsed) << "}";
+    }
+    out << "\n  ]\n}\n";
+}
+
+void write_text(std::ostream& out, const Result& r)
+{
+    out << std::left << std::setw(48) << r.name << std::right;
+    if(!r.error.empty()) {
+        out << " ERROR: " << r.error << std::endl;
+        return;
+    }
+    out << std::fixed << std::setprecision(1)
+        << std::setw(14) << double(r.elapsed.count()) / r.iterations << " ns/op"
+        << std::setw(12) << r.iterations << " it";
+    if(r.bytes)
+        out << std::setw(12) << per_second(r.bytes, r.elapsed) / (1 << 20) << " MiB/s";
+    out << std::endl;
+}
+
+int usage(const char* program)
+{
+    std::cerr << "usage: " << program << " [--min-time <seconds>] [--json <file>|-] [--list] [filter...]\n"
+              << "runs the benchmarks whose name contains any of the filters (all of them by default)" << std::endl;
+    return 2;
+}
+
+} // namespace
+
+
+Registration::Registration(const std::string& name, Benchmark b)
+{
+    registry().push_back(Entry{name, std::move(b)});
+}
+
+Registration::Registration(const std::string& name, const std::vector<size_t>& args, ParametricBenchmark b)
+{
+    for(auto arg : args)
+        registry().push_back(Entry{name + "/" + std::to_string(arg), [b, arg](Run& run) { b(run, arg); }});
+}
+
+const std::string& temporary_directory()
+{
+    static TemporaryDirectory dir;
+    return dir.path;
+}
+
+} // namespace bench
+} // namespace cynnypp
+} // namespace cynny
+
+
+int main(int argc, char** argv)
+{
+    using namespace cynny::cynnypp::bench;
+
+    std::chrono::nanoseconds min_time = std::chrono::milliseconds{500};
+    std::string json;
+    bool list = false;
+    std::vector<std::string> filters;
+    for(int i = 1; i < argc; ++i) {
+        if(!std::strcmp(argv[i], "--min-time") && i + 1 < argc)
+            min_time = std::chrono::nanoseconds{static_cast<int64_t>(std::atof(argv[++i]) * 1e9)};
+        else if(!std::strcmp(argv[i], "--json") && i + 1 < argc)
+            json = argv[++i];
+        else if(!std::strcmp(argv[i], "--list"))
+            list = true;
+        else if(argv[i][0] == '-')
+            return usage(argv[0]);
+        else
+            filters.push_back(argv[i]);
+    }
+
+    // the text report goes to stderr when the json one takes stdout
+    std::ostream& text = json == "-" ? std::cerr : std::cout;
+    std::vector<Result> results;
+    bool failed = false;
+    for(auto& e : registry()) {
+        auto selected = filters.empty() || std::any_of(filters.begin(), filters.end(), [&e](const std::string& f) {
+            return e.name.find(f) != std::string::npos;
+        });
+        if(!selected)
+            continue;
+        if(list) {
+            std::cout << e.name << std::endl;
+            continue;
+        }
+        results.push_back(measure(e, min_time));
+        failed = failed || !results.back().error.empty();
+        write_text(text, results.back());
+    }
+
+    if(json == "-") {
+        write_json(std::cout, results);
+    }
+    else if(!json.empty()) {
+        std::ofstream out{json};
+        write_json(out, results);
+        if(!out) {
+            std::cerr << "cannot write " << json << std::endl;
+            return 1;
+        }
+    }
+    return failed ? 1 : 0;
+}
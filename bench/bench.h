@@ -0,0 +1,92 @@
+#ifndef CYNNYPP_BENCH_H
+#define CYNNYPP_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+namespace cynny {
+namespace cynnypp {
+namespace bench {
+
+/**
+ * @brief The Run class is what a benchmark receives each time it is run: the number of iterations it has to perform
+ * and the clock measuring them.
+ *
+ * The clock starts right before the benchmark is called and stops when it returns; a benchmark that needs some setup
+ * calls reset_timer() once it is done, or pauses the clock around the setup of each iteration,
+ * so that only the iterations are measured.
+ */
+class Run {
+public:
+    explicit Run(uint64_t iterations) : iterations_{iterations}, start_{Clock::now()} {}
+
+    uint64_t iterations() const noexcept { return iterations_; }
+
+    /**
+     * @brief reset_timer discards the time elapsed since the benchmark has been called.
+     */
+    void reset_timer() { start_ = Clock::now(); measured_ = Clock::duration::zero(); running_ = true; }
+
+    /**
+     * @brief pause_timer and resume_timer exclude from the measure what happens between them.
+     */
+    void pause_timer() { if(running_) measured_ += Clock::now() - start_; running_ = false; }
+    void resume_timer() { if(!running_) start_ = Clock::now(); running_ = true; }
+
+    /**
+     * @brief set_bytes declares how many bytes have been processed by all the iterations, to report the throughput.
+     */
+    void set_bytes(uint64_t bytes) noexcept { bytes_ = bytes; }
+
+    uint64_t bytes() const noexcept { return bytes_; }
+    std::chrono::nanoseconds elapsed() const { return measured_ + (running_ ? Clock::now() - start_ : Clock::duration::zero()); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t iterations_;
+    uint64_t bytes_ = 0;
+    Clock::time_point start_;
+    Clock::duration measured_ = Clock::duration::zero();
+    bool running_ = true;
+};
+
+using Benchmark = std::function<void(Run&)>;
+using ParametricBenchmark = std::function<void(Run&, size_t)>;
+
+/**
+ * @brief The Registration class adds benchmarks to the ones run by bench_all; it is meant to be instantiated
+ * as a static object in the translation unit defining them.
+ *
+ * A parametric benchmark is registered once per argument, with the argument appended to its name
+ * (e.g. "fs/readFile/4096").
+ */
+struct Registration {
+    Registration(const std::string& name, Benchmark b);
+    Registration(const std::string& name, const std::vector<size_t>& args, ParametricBenchmark b);
+};
+
+/**
+ * @brief temporary_directory returns a directory, created on first use and removed at exit,
+ * in which the benchmarks can create their files.
+ */
+const std::string& temporary_directory();
+
+/**
+ * @brief do_not_optimize prevents the compiler from dropping the computation of a value that is never used.
+ */
+template<typename T>
+inline void do_not_optimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace bench
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_BENCH_H
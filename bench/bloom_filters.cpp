@@ -0,0 +1,55 @@
+#include "bench.h"
+#include <bloom_filters/bloom_filters.hpp>
+#include <bloom_filters/counting_bloom_filters.hpp>
+
+
+using namespace cynny::cynnypp::bloom_filters;
+using namespace cynny::cynnypp::bench;
+
+namespace {
+
+const size_t bits = 1 << 20;
+const uint8_t hashes = 4;
+
+Registration bloom_filter_set{"bloom_filter/set", [](Run& run) {
+    BloomFilter<bits, hashes, int> bf(std::hash<int>{});
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i)
+        bf.set(static_cast<int>(i));
+}};
+
+Registration bloom_filter_has{"bloom_filter/has", [](Run& run) {
+    BloomFilter<bits, hashes, int> bf(std::hash<int>{});
+    for(int i = 0; i < 100000; ++i)
+        bf.set(i * 2);
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i)
+        do_not_optimize(bf.has(static_cast<int>(i % 200000)));
+}};
+
+Registration counting_bloom_filter_set{"counting_bloom_filter/set", [](Run& run) {
+    CountingBloomFilter<bits, hashes, 4, int> bf({std::hash<int>{}});
+    // the counters saturate at 15: the elements are removed, out of the measure, every batch of them
+    const uint64_t batch = bits / 32;
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i) {
+        bf.set(static_cast<int>(i % batch));
+        if(i % batch == batch - 1) {
+            run.pause_timer();
+            for(uint64_t j = 0; j < batch; ++j)
+                bf.remove(static_cast<int>(j));
+            run.resume_timer();
+        }
+    }
+}};
+
+Registration counting_bloom_filter_has{"counting_bloom_filter/has", [](Run& run) {
+    CountingBloomFilter<bits, hashes, 4, int> bf({std::hash<int>{}});
+    for(int i = 0; i < 100000; ++i)
+        bf.set(i * 2);
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i)
+        do_not_optimize(bf.has(static_cast<int>(i % 200000)));
+}};
+
+} // namespace
@@ -0,0 +1,175 @@
+#include "bench.h"
+#include "io/async/fs/fs_manager.h"
+#include <boost/asio.hpp>
+#include <cstdlib>
+
+
+using namespace cynny::cynnypp::filesystem;
+using namespace cynny::cynnypp::bench;
+
+namespace {
+
+const std::vector<size_t> sizes{4 << 10, 64 << 10, 1 << 20};
+const std::vector<size_t> chunk_sizes{4 << 10, 64 << 10, 1 << 20};
+// number of asynchronous operations kept in flight by the throughput benchmarks
+const size_t window = 32;
+// size of the file read by the chunked streams
+const size_t stream_size = 16 << 20;
+
+// backend of the FilesystemManager, selected as for the tests by the CYNNYPP_FS_BACKEND environment variable
+FilesystemManager::Backend backend()
+{
+    const char* backend = std::getenv("CYNNYPP_FS_BACKEND");
+    return backend && std::string{backend} == "io_uring" ? FilesystemManager::Backend::io_uring : FilesystemManager::Backend::threads;
+}
+
+Path bench_file(const std::string& name, size_t size = 0)
+{
+    auto p = temporary_directory() + "/" + name;
+    writeFile(p, Buffer(size, 'a'));
+    return p;
+}
+
+/*
+ * Run the handlers of io until done is set.
+ */
+void wait(boost::asio::io_service& io, const bool& done)
+{
+    {
+        boost::asio::io_service::work keep_alive{io};
+        while(!done)
+            io.run_one();
+    }
+    // releasing the work has stopped io
+    io.reset();
+}
+
+/*
+ * Keep up to window operations submitted through submit in flight, until all the iterations of the run are completed.
+ */
+void run_async(Run& run, boost::asio::io_service& io, std::function<void(FilesystemManager::CompletionHandler)> submit)
+{
+    uint64_t submitted = 0, completed = 0;
+    bool done = false;
+    FilesystemManager::CompletionHandler h = [&](const ErrorCode& ec, size_t) {
+        if(ec != ErrorCode::success)
+            throw ec;
+        done = ++completed == run.iterations();
+        if(submitted < run.iterations()) {
+            ++submitted;
+            submit(h);
+        }
+    };
+    for(; submitted < std::min<uint64_t>(window, run.iterations()); ++submitted)
+        submit(h);
+    wait(io, done);
+}
+
+Registration read_file{"fs/readFile", sizes, [](Run& run, size_t size) {
+    auto p = bench_file("read_file", size);
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i)
+        do_not_optimize(readFile(p));
+    run.set_bytes(run.iterations() * size);
+}};
+
+Registration write_file{"fs/writeFile", sizes, [](Run& run, size_t size) {
+    auto p = bench_file("write_file");
+    Buffer data(size, 'w');
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i)
+        writeFile(p, data);
+    run.set_bytes(run.iterations() * size);
+}};
+
+Registration append_to_file{"fs/appendToFile", sizes, [](Run& run, size_t size) {
+    auto p = bench_file("append_to_file");
+    Buffer data(size, 'p');
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i)
+        appendToFile(p, data);
+    run.set_bytes(run.iterations() * size);
+}};
+
+Registration async_read{"fs/async_read", sizes, [](Run& run, size_t size) {
+    boost::asio::io_service io;
+    FilesystemManager fs{io, 1, backend()};
+    auto p = bench_file("async_read", size);
+    std::vector<Buffer> buffers(window);
+    size_t next = 0;
+    run.reset_timer();
+    run_async(run, io, [&](FilesystemManager::CompletionHandler h) {
+        fs.async_read(p, buffers[next++ % window], std::move(h));
+    });
+    run.set_bytes(run.iterations() * size);
+}};
+
+Registration async_write{"fs/async_write", sizes, [](Run& run, size_t size) {
+    boost::asio::io_service io;
+    FilesystemManager fs{io, 1, backend()};
+    std::vector<Path> paths;
+    for(size_t i = 0; i < window; ++i)
+        paths.push_back(bench_file("async_write." + std::to_string(i)));
+    Buffer data(size, 'w');
+    size_t next = 0;
+    run.reset_timer();
+    run_async(run, io, [&](FilesystemManager::CompletionHandler h) {
+        fs.async_write(paths[next++ % window], data, std::move(h));
+    });
+    run.set_bytes(run.iterations() * size);
+}};
+
+Registration async_append{"fs/async_append", sizes, [](Run& run, size_t size) {
+    boost::asio::io_service io;
+    FilesystemManager fs{io, 1, backend()};
+    auto p = bench_file("async_append");
+    Buffer data(size, 'p');
+    run.reset_timer();
+    run_async(run, io, [&](FilesystemManager::CompletionHandler h) {
+        fs.async_append(p, data, std::move(h));
+    });
+    run.set_bytes(run.iterations() * size);
+}};
+
+// latency of a single small read, from its submission to its handler
+Registration async_read_roundtrip{"fs/async_read_roundtrip", [](Run& run) {
+    boost::asio::io_service io;
+    FilesystemManager fs{io, 1, backend()};
+    auto p = bench_file("async_read_roundtrip", 64);
+    Buffer buf;
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i) {
+        bool done = false;
+        fs.async_read(p, buf, [&done](const ErrorCode& ec, size_t) {
+            if(ec != ErrorCode::success)
+                throw ec;
+            done = true;
+        });
+        wait(io, done);
+    }
+}};
+
+Registration chunked_stream{"fs/chunked_stream", chunk_sizes, [](Run& run, size_t chunk_size) {
+    boost::asio::io_service io;
+    FilesystemManager fs{io, 1, backend()};
+    auto p = bench_file("chunked_stream", stream_size);
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i) {
+        auto stream = fs.make_chunked_stream(p, chunk_size);
+        bool done = false;
+        FilesystemManager::ReadChunkHandler next;
+        next = [&stream, &next, &done](const ErrorCode& ec, Buffer b) {
+            do_not_optimize(b.data());
+            if(ec == ErrorCode::success)
+                return stream->next_chunk(next);
+            if(ec != ErrorCode::end_of_file)
+                throw ec;
+            done = true;
+        };
+        stream->next_chunk(next);
+        wait(io, done);
+    }
+    run.set_bytes(run.iterations() * stream_size);
+}};
+
+} // namespace
@@ -0,0 +1,54 @@
+#include "bench.h"
+#include <signal/bus.hpp>
+#include <signal/signal.hpp>
+#include <memory>
+
+
+using namespace cynny::cynnypp::signal;
+using namespace cynny::cynnypp::bench;
+
+namespace {
+
+// number of listeners the events are published to
+const std::vector<size_t> listeners{1, 8, 64};
+
+struct Event {
+    explicit Event(uint64_t value) : value{value} {}
+    uint64_t value;
+};
+
+struct OtherEvent { };
+
+struct Listener {
+    void receive(const Event& e) { sum += e.value; }
+    void receive(const OtherEvent&) { }
+    uint64_t sum = 0;
+};
+
+Registration signal_publish{"signal/publish", listeners, [](Run& run, size_t n) {
+    Signal<Event> signal;
+    std::vector<std::shared_ptr<Listener>> receivers;
+    for(size_t i = 0; i < n; ++i) {
+        receivers.push_back(std::make_shared<Listener>());
+        signal.add<Listener, &Listener::receive>(receivers.back());
+    }
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i)
+        signal.publish(Event{i});
+    do_not_optimize(receivers.front()->sum);
+}};
+
+Registration bus_publish{"bus/publish", listeners, [](Run& run, size_t n) {
+    Bus<Event, OtherEvent> bus;
+    std::vector<std::shared_ptr<Listener>> receivers;
+    for(size_t i = 0; i < n; ++i) {
+        receivers.push_back(std::make_shared<Listener>());
+        bus.reg(receivers.back());
+    }
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i)
+        bus.publish<Event>(i);
+    do_not_optimize(receivers.front()->sum);
+}};
+
+} // namespace
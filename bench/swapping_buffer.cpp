@@ -0,0 +1,94 @@
+#include "bench.h"
+#include "io/async/fs/fs_manager.h"
+#include "io/async/swap/swapping_buffer_overwrite.h"
+#include <boost/asio.hpp>
+
+
+using namespace cynny::cynnypp::filesystem;
+using namespace cynny::cynnypp::swapping;
+using namespace cynny::cynnypp::bench;
+
+namespace {
+
+// transaction sizes below and above the swap threshold (SwappingBuffer::maxBufferSize)
+const std::vector<size_t> sizes{256 << 10, 1 << 20, 4 << 20, 16 << 20};
+const size_t chunk_size = 64 << 10;
+
+/*
+ * Run the handlers of io until done is set.
+ */
+void wait(boost::asio::io_service& io, const bool& done)
+{
+    {
+        boost::asio::io_service::work keep_alive{io};
+        while(!done)
+            io.run_one();
+    }
+    // releasing the work has stopped io
+    io.reset();
+}
+
+void fail(const ErrorCode& ec)
+{
+    throw ec;
+}
+
+/*
+ * A transaction with size bytes appended to it, chunk by chunk.
+ */
+std::shared_ptr<SwappingBufferOverwrite> fill(boost::asio::io_service& io, FilesystemManager& fs, size_t size)
+{
+    auto buffer = SwappingBufferOverwrite::make_shared(io, fs, temporary_directory());
+    SwappingBuffer::Buffer chunk(chunk_size, 's');
+    for(size_t appended = 0; appended < size; appended += chunk_size) {
+        bool done = false;
+        buffer->append(chunk, [&done](uint32_t) { done = true; }, fail);
+        wait(io, done);
+    }
+    return buffer;
+}
+
+Registration append{"swap/append", sizes, [](Run& run, size_t size) {
+    boost::asio::io_service io;
+    FilesystemManager fs{io};
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i) {
+        auto buffer = fill(io, fs, size);
+        // the temporary file is removed with the transaction
+        run.pause_timer();
+        buffer.reset();
+        run.resume_timer();
+    }
+    run.set_bytes(run.iterations() * size);
+}};
+
+Registration read_all{"swap/readAll", sizes, [](Run& run, size_t size) {
+    boost::asio::io_service io;
+    FilesystemManager fs{io};
+    auto buffer = fill(io, fs, size);
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i) {
+        bool done = false;
+        buffer->readAll([&done](const SwappingBuffer::Buffer& b) { do_not_optimize(b.data()); done = true; }, fail);
+        wait(io, done);
+    }
+    run.set_bytes(run.iterations() * size);
+}};
+
+Registration save_all_contents{"swap/saveAllContents", sizes, [](Run& run, size_t size) {
+    boost::asio::io_service io;
+    FilesystemManager fs{io};
+    auto destination = temporary_directory() + "/saved";
+    run.reset_timer();
+    for(uint64_t i = 0; i < run.iterations(); ++i) {
+        run.pause_timer();
+        auto buffer = fill(io, fs, size);
+        run.resume_timer();
+        bool done = false;
+        buffer->saveAllContents(destination, [&done]() { done = true; }, fail);
+        wait(io, done);
+    }
+    run.set_bytes(run.iterations() * size);
+}};
+
+} // namespace
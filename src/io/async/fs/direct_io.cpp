@@ -0,0 +1,190 @@
+#include "path_checks.h"
+#include "direct_io.h"
+#include "posix_file.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+using boost::filesystem::file_type;
+
+namespace {
+
+// size of the bounce buffer, i.e. the maximum length of a single transfer
+constexpr size_t bounce_size = 256 * direct_io_alignment;
+
+size_t align_down(size_t n) { return n - n % direct_io_alignment; }
+size_t align_up(size_t n) { return align_down(n + direct_io_alignment - 1); }
+
+/**
+ * @brief The AlignedBuffer class owns a block of memory suitably aligned for O_DIRECT transfers.
+ */
+class AlignedBuffer {
+public:
+    explicit AlignedBuffer(size_t size)
+        : data_{nullptr}
+        , size_{size}
+    {
+        void* p;
+        if(posix_memalign(&p, direct_io_alignment, size) != 0)
+            throw ErrorCode(ErrorCode::internal_failure, "unable to allocate an aligned buffer for direct I/O");
+        data_ = static_cast<uint8_t*>(p);
+    }
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+    ~AlignedBuffer() { free(data_); }
+
+    uint8_t* data() { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    uint8_t* data_;
+    size_t size_;
+};
+
+// open p with O_DIRECT, unless the filesystem does not support it
+File open_direct(const Path& p, int flags)
+{
+    File f(p, flags | O_DIRECT);
+    // O_DIRECT is refused with EINVAL by the filesystems that do not support it
+    if(!f && errno == EINVAL)
+        f = File(p, flags);
+    return f;
+}
+
+/*
+ * Write len bytes from data at offset off, which must be aligned, through the bounce buffer.
+ * Whole blocks are written, so the caller must cut the file to its actual size.
+ * Returns false on failure, with errno set.
+ */
+bool write_blocks(int fd, off_t off, const uint8_t* data, size_t len, AlignedBuffer& bounce)
+{
+    size_t done = 0;
+    while(done < len) {
+        size_t n = std::min(len - done, bounce.size());
+        std::memcpy(bounce.data(), data + done, n);
+        done += n;
+
+        // zero the padding of the last block
+        size_t padded = align_up(n);
+        std::memset(bounce.data() + n, 0, padded - n);
+        for(size_t written = 0; written < padded; ) {
+            auto ret = pwrite(fd, bounce.data() + written, padded - written, off + written);
+            if(ret < 0 && errno == EINTR)
+                continue;
+            if(ret <= 0)
+                return false;
+            written += ret;
+        }
+        // every transfer but the last one fills the whole bounce buffer, so the offset stays aligned
+        off += n;
+    }
+    return true;
+}
+
+} // namespace
+
+
+Buffer readFileDirect(const Path& p)
+{
+    Buffer ret;
+    readFileDirect(p, ret);
+    return ret;
+}
+
+
+void readFileDirect(const Path& p, Buffer& ret)
+{
+    // check and throw if needed
+    check_path_admitted<file_type::regular_file, file_type::symlink_file>(p);
+
+    auto f = open_direct(p, O_RDONLY);
+    if(!f)
+        throw ErrorCode(ErrorCode::open_failure, std::string{__func__} + " was not able to open the file " + p + " in read mode");
+
+    auto size = f.size();
+    if(size < 0)
+        throw ErrorCode(ErrorCode::read_failure, std::string{__func__} + " was not able to get the size of the file " + p);
+
+    ret.resize(size);
+    AlignedBuffer bounce(std::min(bounce_size, align_up(ret.size())));
+    size_t done = 0;
+    while(done < ret.size()) {
+        auto n = pread(f.fd(), bounce.data(), bounce.size(), done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            throw ErrorCode(ErrorCode::read_failure, std::string{__func__} + " was not able to read from file " + p + " after reading " + std::to_string(done) + " characters");
+        auto useful = std::min(static_cast<size_t>(n), ret.size() - done);
+        std::memcpy(ret.data() + done, bounce.data(), useful);
+        done += useful;
+        // a short read can only happen at the end of the file
+        if(static_cast<size_t>(n) < bounce.size())
+            break;
+    }
+    if(done < ret.size())
+        throw ErrorCode(ErrorCode::read_failure, std::string{__func__} + " was not able to read from file " + p + " after reading " + std::to_string(done) + " characters");
+}
+
+
+void writeFileDirect(const Path& p, const Buffer& buf)
+{
+    // check and throw if needed
+    check_path_admitted<file_type::file_not_found, file_type::regular_file>(p);
+
+    auto f = open_direct(p, O_WRONLY | O_CREAT | O_TRUNC);
+    if(!f)
+        throw ErrorCode(ErrorCode::open_failure, std::string{__func__} + " was not able to open the file " + p + " in write mode");
+    if(buf.empty())
+        return;
+
+    AlignedBuffer bounce(std::min(bounce_size, align_up(buf.size())));
+    if(!write_blocks(f.fd(), 0, buf.data(), buf.size(), bounce) || ftruncate(f.fd(), buf.size()) < 0)
+        throw ErrorCode(ErrorCode::write_failure, std::string{__func__} + " was not able to write to the file " + p + ": " + last_error());
+}
+
+
+void appendToFileDirect(const Path& p, const Buffer& bytes)
+{
+    // check and throw if needed
+    check_path_admitted<file_type::file_not_found, file_type::regular_file>(p);
+
+    // as with appendToFile, each append is written at the end of the file atomically, even if others append to it meanwhile
+    auto f = open_direct(p, O_WRONLY | O_CREAT | O_APPEND);
+    if(!f)
+        throw ErrorCode(ErrorCode::open_failure, std::string{__func__} + " was not able to open the file " + p + " in write mode");
+    if(bytes.empty())
+        return;
+
+    // only whole blocks can be appended directly at a block boundary: anything else goes through the page cache,
+    // so that no padding is ever written, not even for a while
+    size_t done = 0;
+    auto size = f.size();
+    if(size >= 0 && size % direct_io_alignment == 0 && bytes.size() % direct_io_alignment == 0) {
+        // a single transfer, to keep the append atomic
+        AlignedBuffer aligned(bytes.size());
+        std::memcpy(aligned.data(), bytes.data(), bytes.size());
+        ssize_t n;
+        do {
+            n = ::write(f.fd(), aligned.data(), aligned.size());
+        } while(n < 0 && errno == EINTR);
+        // EINVAL: the end of the file is not at a block boundary anymore, someone else has appended meanwhile
+        if(n < 0 && errno != EINVAL)
+            throw ErrorCode(ErrorCode::append_failure, std::string{__func__} + " was not able to append to file " + p + ": " + last_error());
+        done = n > 0 ? n : 0;
+    }
+    if(done < bytes.size() && (fcntl(f.fd(), F_SETFL, O_APPEND) < 0 || !f.write(bytes.data() + done, bytes.size() - done)))
+        throw ErrorCode(ErrorCode::append_failure, std::string{__func__} + " was not able to append to file " + p + ": " + last_error());
+}
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
@@ -0,0 +1,41 @@
+#ifndef CYNNYPP_FS_DIRECT_IO_H
+#define CYNNYPP_FS_DIRECT_IO_H
+
+#include "fs_manager_interface.h"
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+/**
+ * @brief Alignment of offsets, lengths and memory addresses of the transfers performed with O_DIRECT.
+ */
+constexpr size_t direct_io_alignment = pageSize;
+
+/*
+ * The following functions behave as readFile, writeFile and appendToFile, but the file is opened
+ * with O_DIRECT, so that the data does not go through (and does not pollute) the page cache.
+ *
+ * The data are transferred through an aligned bounce buffer, so the caller's buffers need not be aligned.
+ * Files are written in whole blocks: an unaligned tail is padded and then cut with ftruncate.
+ * Appends are performed with O_APPEND, as by appendToFile, and directly only if both the file and the data
+ * are made of whole blocks: any other append goes through the page cache, so that appending never exposes
+ * any padding, nor overwrites what others append meanwhile.
+ * If the filesystem does not support O_DIRECT (e.g. tmpfs), the file is accessed through the page cache.
+ */
+
+Buffer readFileDirect(const Path& p);
+
+void readFileDirect(const Path& p, Buffer& buf);
+
+void writeFileDirect(const Path& p, const Buffer& buf);
+
+void appendToFileDirect(const Path& p, const Buffer& bytes);
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_DIRECT_IO_H
@@ -0,0 +1,76 @@
+#include "path_checks.h"
+#include "file_cache.h"
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+using boost::filesystem::file_type;
+
+std::shared_ptr<File> FileCache::acquire(const Path& p, bool create, bool append)
+{
+    std::lock_guard<std::mutex> lock(m);
+
+    auto it = index.find(p);
+    if(it != index.end()) {
+        lru.splice(lru.begin(), lru, it->second);
+        auto& f = append ? it->second->appender : it->second->file;
+        if(!f) {
+            // the other descriptor of the file is cached: open this one too
+            auto opened = std::make_shared<File>(p, append ? O_WRONLY | O_APPEND : O_RDWR);
+            if(!*opened)
+                return nullptr;
+            f = std::move(opened);
+        }
+        return f;
+    }
+
+    // only regular files are cached: any other type is left to the uncached path, which checks it
+    try {
+        auto type = boost::filesystem::symlink_status(p).type();
+        if(type != file_type::regular_file && !(create && type == file_type::file_not_found))
+            return nullptr;
+    }
+    catch(const boost::filesystem::filesystem_error&) {
+        return nullptr;
+    }
+
+    auto f = std::make_shared<File>(p, (append ? O_WRONLY | O_APPEND : O_RDWR) | (create ? O_CREAT : 0));
+    if(!*f)
+        return nullptr;
+
+    if(index.size() >= capacity) {
+        index.erase(lru.back().path);
+        lru.pop_back();
+    }
+    lru.push_front(append ? Entry{p, nullptr, f} : Entry{p, f, nullptr});
+    index.emplace(p, lru.begin());
+    return f;
+}
+
+void FileCache::invalidate(const Path& p)
+{
+    auto base = p;
+    while(base.size() > 1 && base.back() == '/')
+        base.pop_back();
+
+    std::lock_guard<std::mutex> lock(m);
+
+    auto it = index.find(base);
+    if(it != index.end()) {
+        lru.erase(it->second);
+        index.erase(it);
+    }
+    // the paths below base are those between base + '/' and base + '0', the character following '/'
+    auto first = index.lower_bound(base + '/');
+    auto last = index.lower_bound(base + '0');
+    for(auto below = first; below != last; ++below)
+        lru.erase(below->second);
+    index.erase(first, last);
+}
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
@@ -0,0 +1,69 @@
+#ifndef CYNNYPP_FS_FILE_CACHE_H
+#define CYNNYPP_FS_FILE_CACHE_H
+
+#include "posix_file.h"
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+/**
+ * @brief The FileCache class is a bounded LRU cache of the descriptors of regular files, opened read-write
+ * and keyed by path, so that consecutive operations on the same file do not open, check and close it again.
+ * The appends get a second descriptor of the file, opened with O_APPEND, so that each of them is written
+ * at the end of the file atomically, as through an uncached descriptor, even if others append to it meanwhile.
+ *
+ * Descriptors are handed out as shared pointers: a descriptor evicted or invalidated while in use
+ * is closed when the last user releases it. Paths are compared as strings, so the same file
+ * reached through different paths gets different entries.
+ *
+ * All the functions can be invoked by any thread.
+ */
+class FileCache {
+public:
+    explicit FileCache(size_t capacity) : capacity{capacity} {}
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    /**
+     * @brief acquire returns the descriptor of the regular file p, opening it on a miss.
+     * @param p the path to the file
+     * @param create whether a file that does not exist has to be created
+     * @param append whether the descriptor is the one for the appends, opened write-only with O_APPEND
+     * @return the descriptor, or an empty pointer if p is not a regular file (e.g. it is a symlink,
+     * or it does not exist and create is false) or it cannot be opened read-write; in this case
+     * the caller is expected to access the file without the cache
+     */
+    std::shared_ptr<File> acquire(const Path& p, bool create, bool append = false);
+
+    /**
+     * @brief invalidate forgets the descriptors of p and of all the paths below it.
+     */
+    void invalidate(const Path& p);
+
+private:
+    struct Entry {
+        Path path;
+        std::shared_ptr<File> file;
+        std::shared_ptr<File> appender;
+    };
+
+    const size_t capacity;
+    std::mutex m;
+    // most recently used first
+    std::list<Entry> lru;
+    // ordered, so that the paths below a directory are contiguous
+    std::map<Path, std::list<Entry>::iterator> index;
+};
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_FILE_CACHE_H
@@ -1,17 +1,18 @@
-#define BOOST_FILESYSTEM_NO_DEPRECATED
-#define GCC_VERSION (__GNUC__ * 10000 \
-                               + __GNUC_MINOR__ * 100 \
-                               + __GNUC_PATCHLEVEL__)
-/* Test for GCC > 3.2.0 */
-#if GCC_VERSION  < 50300
-#define BOOST_NO_CXX11_SCOPED_ENUMS
-#endif
-
-#include <boost/filesystem.hpp>
+#include "path_checks.h"
 #include "fs_manager.h"
+#include "fs_operations.h"
+#include "fs_manager_uring.h"
+#include "direct_io.h"
+#include "file_cache.h"
+#include "metadata_cache.h"
+#include "posix_file.h"
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include <sstream>
 #include <cassert>
 #include <iostream>
+#include <algorithm>
 #include "io/locales.h"
 
 namespace cynny {
@@ -23,76 +24,47 @@ using namespace impl;
 
 
 // -----------------------------------------------------------------------------------------------
-// is_admitted: check whether a file_type is among those specified in the template parameters pack
+// standalone helper functions for filesytem synchronous I/O operations
+//
+// The functions with a trailing underscore check the paths through the MetadataCache they receive, if any:
+// the standalone functions pass none, while the FilesystemManager passes its own.
 // -----------------------------------------------------------------------------------------------
-template<boost::filesystem::file_type Admitted>
-static constexpr bool is_admitted(boost::filesystem::file_type t)
-{
-    return t == Admitted;
-}
-
-template<boost::filesystem::file_type Head, boost::filesystem::file_type... Tail>
-using enable_if_t = typename std::enable_if<sizeof...(Tail) != 0, bool>::type;
 
-template<boost::filesystem::file_type Head, boost::filesystem::file_type... Tail>
-static constexpr enable_if_t<Head, Tail...> is_admitted(boost::filesystem::file_type t)
+/*
+ * Whether p is a directory, following symlinks as boost::filesystem::is_directory does.
+ */
+static bool is_directory_(const boost::filesystem::path& p, MetadataCache* cache)
 {
-    return t == Head || is_admitted<Tail...>(t);
+    if(!cache)
+        return boost::filesystem::is_directory(p);
+    auto type = cache->lookup(p.native()).type;
+    return type == file_type::directory_file || (type == file_type::symlink_file && boost::filesystem::is_directory(p));
 }
 
 
-// -----------------------------------------------------------------------------------------------
-// check_path_admitted: check whether the type of the path is among the admitted ones
-// -----------------------------------------------------------------------------------------------
-template<boost::filesystem::file_type... Admitted>
-static boost::filesystem::file_status check_path_admitted(const boost::filesystem::path& p)
+static bool exists_(const Path& p, MetadataCache* cache)
 {
-    using boost::filesystem::file_type;
-
+    // check and throw if needed
+    auto status = check_path_admitted<file_type::file_not_found,file_type::regular_file,file_type::directory_file, file_type::symlink_file>(p, cache);
     try {
-        auto status = boost::filesystem::symlink_status(p);
-        auto type = status.type();
-
-        // admit only file_not_found, regular_file or directory_file
-        if(!is_admitted<Admitted...>(type))
-        {
-            std::string msg = std::string("path \"") + p.native() + "\" is not admitted";
-            throw ErrorCode(ErrorCode::invalid_argument, msg);
-        }
-
-        return status;
+        return boost::filesystem::exists(status);
     }
-    // capture boosts exceptions to rethrow a FilesystemError
-    catch(boost::filesystem::filesystem_error& e)
-    {
+    catch (const boost::filesystem::filesystem_error& e) {
         throw ErrorCode(ErrorCode::internal_failure, e.what());
     }
 }
 
-
-
-// -----------------------------------------------------------------------------------------------
-// standalone helper functions for filesytem synchronous I/O operations
-// -----------------------------------------------------------------------------------------------
-
 bool exists(const Path& p)
 {
-    // check and throw if needed
-    auto status = check_path_admitted<file_type::file_not_found,file_type::regular_file,file_type::directory_file, file_type::symlink_file>(p);
-    try {
-        return boost::filesystem::exists(status);
-    }
-    catch (const boost::filesystem::filesystem_error& e) {
-        throw ErrorCode(ErrorCode::internal_failure, e.what());
-    }
+    return exists_(p, nullptr);
 }
 
 
-bool removeFile(const Path& p)
+static bool removeFile_(const Path& p, MetadataCache* cache)
 {
     boost::filesystem::path boost_path{p};
     // check and throw if needed
-    check_path_admitted<file_type::file_not_found,file_type::regular_file>(boost_path);
+    check_path_admitted<file_type::file_not_found,file_type::regular_file>(boost_path, cache);
     try {
         return boost::filesystem::remove(boost_path);
     }
@@ -101,11 +73,16 @@ bool removeFile(const Path& p)
     }
 }
 
-static void move_(const boost::filesystem::path& from, const boost::filesystem::path& to)
+bool removeFile(const Path& p)
+{
+    return removeFile_(p, nullptr);
+}
+
+static void move_(const boost::filesystem::path& from, const boost::filesystem::path& to, MetadataCache* cache)
 {
     // if the destination path already exists and is a directory, I must emulate "mv" command behavior
-    if(boost::filesystem::is_directory(to))
-        return move_(from, to / *--from.end());
+    if(is_directory_(to, cache))
+        return move_(from, to / *--from.end(), cache);
 
     try {
         boost::filesystem::rename(from, to);
@@ -116,41 +93,90 @@ static void move_(const boost::filesystem::path& from, const boost::filesystem::
 }
 
 
-void move(const Path &from, const Path &to)
+static void move_(const Path &from, const Path &to, MetadataCache* cache)
 {
     boost::filesystem::path boost_from{from};
     boost::filesystem::path boost_to{to};
 
     // check and throw if needed
-    check_path_admitted<file_type::regular_file,file_type::directory_file>(boost_from);
+    check_path_admitted<file_type::regular_file,file_type::directory_file>(boost_from, cache);
 
-    move_(boost_from, boost_to);
+    move_(boost_from, boost_to, cache);
 }
 
+void move(const Path &from, const Path &to)
+{
+    move_(from, to, nullptr);
+}
 
-void copyFile(const Path& from, const Path& to)
+
+/*
+ * Copy the content of a regular file with a reflink or with copy_file_range, so that data do not
+ * go through user space; the copy is left to boost if the filesystems support neither.
+ */
+static void copyFile_(const boost::filesystem::path& from, const boost::filesystem::path& to, bool overwrite)
+{
+    File in(from.native(), O_RDONLY);
+    struct stat st_in;
+    if(!in || fstat(in.fd(), &st_in) < 0)
+        throw ErrorCode(ErrorCode::open_failure, "copyFile was not able to open the file " + from.native() + " in read mode");
+
+    // the destination is truncated only after having checked that it is not the source itself
+    File out(to.native(), O_WRONLY | O_CREAT | (overwrite ? 0 : O_EXCL), st_in.st_mode & 07777);
+    struct stat st_out;
+    if(!out || fstat(out.fd(), &st_out) < 0)
+        throw ErrorCode(ErrorCode::open_failure, "copyFile was not able to open the file " + to.native() + " in write mode: " + last_error());
+    if(st_in.st_dev == st_out.st_dev && st_in.st_ino == st_out.st_ino)
+        throw ErrorCode(ErrorCode::operation_not_permitted, "source and destination match");
+    if(ftruncate(out.fd(), 0) < 0)
+        throw ErrorCode(ErrorCode::write_failure, "copyFile was not able to truncate the file " + to.native() + ": " + last_error());
+
+    switch(copy_in_kernel(in, out, st_in.st_size)) {
+    case KernelCopy::done:
+        return;
+    case KernelCopy::failed:
+        throw ErrorCode(ErrorCode::internal_failure, "copyFile was not able to copy " + from.native() + " to " + to.native() + ": " + last_error());
+    case KernelCopy::unsupported:
+        break;
+    }
+
+    in.close();
+    out.close();
+    try {
+        boost::filesystem::copy_file(from, to, boost::filesystem::copy_option::overwrite_if_exists);
+    }
+    catch (const boost::filesystem::filesystem_error& e) {
+        throw ErrorCode(ErrorCode::internal_failure, e.what());
+    }
+}
+
+
+static void copyFile_(const Path& from, const Path& to, MetadataCache* cache)
 {
     if(from == to)
         throw ErrorCode(ErrorCode::operation_not_permitted, "source and destination match");
     boost::filesystem::path boost_from{from};
     boost::filesystem::path boost_to{to};
     // check and throw if needed
-    check_path_admitted<file_type::regular_file>(boost_from);
+    check_path_admitted<file_type::regular_file>(boost_from, cache);
     // if to is a directory, we copy the file inside it
-    if(boost::filesystem::is_directory(boost_to) && boost::filesystem::exists(boost_to))
+    if(is_directory_(boost_to, cache))
         boost_to /= boost_from.filename();
-    try {
-        boost::filesystem::copy_file(boost_from, boost_to, boost::filesystem::copy_option::overwrite_if_exists);
-    }
-    catch (const boost::filesystem::filesystem_error& e) {
-        throw ErrorCode(ErrorCode::internal_failure, e.what());
-    }
+    copyFile_(boost_from, boost_to, true);
 }
 
-/* 
+void copyFile(const Path& from, const Path& to)
+{
+    copyFile_(from, to, nullptr);
+}
+
+/*
+ * Create the directory tree rooted in from, as copyDirectory does, collecting the regular files to be copied:
+ * every directory is created before the files and the directories it contains.
+ *
  * Precondition: boost::filesystem::is_directory(from) == true
  */
-void copyDirectory_(const boost::filesystem::path& from, const boost::filesystem::path& to_)
+static void makeDirectoryTree_(const boost::filesystem::path& from, const boost::filesystem::path& to_, std::vector<FileCopy>& files)
 {
     try {
         // if "to_" is a directory, we copy the dir and its content inside "from"
@@ -160,15 +186,15 @@ void copyDirectory_(const boost::filesystem::path& from, const boost::filesystem
 
         // boost copy_directory just create a new directory with copied attributes
         boost::filesystem::copy_directory(from, actual_to);
-        
-        // recursively copy directory content
+
+        // recursively collect directory content
         boost::filesystem::directory_iterator end_itr;
         for(boost::filesystem::directory_iterator p(from);  p != end_itr; ++p) {
             const auto& sub_to = actual_to / p->path().filename();
             if(boost::filesystem::is_directory(*p))
-                copyDirectory_(*p, sub_to);
+                makeDirectoryTree_(*p, sub_to, files);
             else if(boost::filesystem::symlink_status(*p).type() == file_type::regular_file)
-                boost::filesystem::copy(*p, sub_to);
+                files.push_back(FileCopy{p->path().native(), sub_to.native(), boost::filesystem::file_size(*p)});
         }
     }
     catch (const boost::filesystem::filesystem_error& e) {
@@ -176,6 +202,17 @@ void copyDirectory_(const boost::filesystem::path& from, const boost::filesystem
     }
 }
 
+/* 
+ * Precondition: boost::filesystem::is_directory(from) == true
+ */
+void copyDirectory_(const boost::filesystem::path& from, const boost::filesystem::path& to_)
+{
+    std::vector<FileCopy> files;
+    makeDirectoryTree_(from, to_, files);
+    for(const auto& f : files)
+        copyFile_(f.from, f.to, false);
+}
+
 void copyDirectory(const Path& from, const Path& to)
 {
     boost::filesystem::path boost_from{from};
@@ -186,11 +223,11 @@ void copyDirectory(const Path& from, const Path& to)
 }
 
 
-uintmax_t removeDirectory(const Path& p)
+static uintmax_t removeDirectory_(const Path& p, MetadataCache* cache)
 {
     boost::filesystem::path boost_path{p};
     // check and throw if needed
-    check_path_admitted<file_type::file_not_found,file_type::directory_file>(boost_path);
+    check_path_admitted<file_type::file_not_found,file_type::directory_file>(boost_path, cache);
     try {
         return boost::filesystem::remove_all(boost_path);
     }
@@ -199,13 +236,18 @@ uintmax_t removeDirectory(const Path& p)
     }
 }
 
+uintmax_t removeDirectory(const Path& p)
+{
+    return removeDirectory_(p, nullptr);
+}
+
 
-bool createDirectory(const Path &p, bool parents)
+static bool createDirectory_(const Path &p, bool parents, MetadataCache* cache)
 {
     boost::filesystem::path boost_path{p};
     if(parents) {
         // check and throw if needed
-        check_path_admitted<file_type::file_not_found,file_type::directory_file>(boost_path);
+        check_path_admitted<file_type::file_not_found,file_type::directory_file>(boost_path, cache);
         try {
             return boost::filesystem::create_directories(boost_path);
         }
@@ -215,14 +257,19 @@ bool createDirectory(const Path &p, bool parents)
     }
     else {
         // check and throw if needed
-        check_path_admitted<file_type::file_not_found>(boost_path);
+        check_path_admitted<file_type::file_not_found>(boost_path, cache);
         // if the directory name ends with a "/", applying parent_path will only remove the trailing "/", so I've to call it twice
         auto parent_path = *--boost_path.end() == "." ? boost_path.parent_path().parent_path() : boost_path.parent_path();
-        check_path_admitted<file_type::directory_file>(parent_path);
+        check_path_admitted<file_type::directory_file>(parent_path, cache);
         return boost::filesystem::create_directory(boost_path);
     }
 }
 
+bool createDirectory(const Path &p, bool parents)
+{
+    return createDirectory_(p, parents, nullptr);
+}
+
 
 // --------------------- file access --------------
 
@@ -244,69 +291,155 @@ Buffer readFile(std::unique_ptr<std::basic_ifstream<uint8_t>> in)
     return ret;
 }
 Buffer readFile(const Path& p)
+{
+    Buffer ret;
+    readFile(p, ret);
+    return ret;
+}
+
+static void readFile_(const Path& p, Buffer& ret, MetadataCache* cache)
 {
     // check and throw if needed
-    check_path_admitted<file_type::regular_file, file_type::symlink_file>(p);
+    check_path_admitted<file_type::regular_file, file_type::symlink_file>(p, cache);
 
-    std::basic_ifstream<uint8_t> in(p, std::ios::in | std::ios::binary | std::ios::ate);
-    if (!in) throw(ErrorCode(ErrorCode::open_failure, std::string{__func__} + " was not able to open the file " + p + " in read mode"));
+    File f(p, O_RDONLY);
+    if (!f) throw(ErrorCode(ErrorCode::open_failure, "readFile was not able to open the file " + p + " in read mode"));
 
-    Buffer ret;
-    ret.resize(in.tellg());
-    in.seekg(0);
-    in.imbue(utilities_locale);
-    in.read(ret.data(), ret.size());
+    auto size = f.size();
+    if (size < 0)
+        throw(ErrorCode(ErrorCode::read_failure, "readFile was not able to get the size of the file " + p + ": " + last_error()));
 
-    if (!in) {
-        std::ostringstream msg(__func__);
-        msg << " was not able to read from file descriptor after reading " << in.gcount() << " characters";
+    // reuse the storage of the buffer: only the bytes beyond its current size get initialised
+    ret.resize(size);
+    auto n = f.read_at(ret.data(), ret.size(), 0);
+    if (n != size) {
+        std::ostringstream msg("readFile");
+        msg << " was not able to read from file descriptor after reading " << std::max<ssize_t>(n, 0) << " characters";
         throw (ErrorCode(ErrorCode::read_failure, msg.str()));
     }
+}
 
-    return ret;
-
+void readFile(const Path& p, Buffer& ret)
+{
+    readFile_(p, ret, nullptr);
 }
 
 
 
 
 
-void writeFile(const Path& p, const Buffer& buf)
+static void writeFile_(const Path& p, const Buffer& buf, MetadataCache* cache)
 {
     // check and throw if needed
-    check_path_admitted<file_type::file_not_found,file_type::regular_file>(p);
+    check_path_admitted<file_type::file_not_found,file_type::regular_file>(p, cache);
 
-    std::basic_ofstream<uint8_t> os(p, std::ios::binary);
-    if(!os)
-        throw(ErrorCode(ErrorCode::open_failure, std::string{__func__} + " was not able to open the file " + p + " in write mode"));
+    File f(p, O_WRONLY | O_CREAT | O_TRUNC);
+    if(!f)
+        throw(ErrorCode(ErrorCode::open_failure, "writeFile was not able to open the file " + p + " in write mode"));
 
-    os.imbue(utilities::utilities_locale);
-    os.write(buf.data(), buf.size());
+    if(!f.write_at(buf.data(), buf.size(), 0))
+        throw(ErrorCode(ErrorCode::write_failure, "writeFile was not able to write to the file " + p + ": " + last_error()));
+}
+
+void writeFile(const Path& p, const Buffer& buf)
+{
+    writeFile_(p, buf, nullptr);
+}
+
+static void writeFileAtomically_(const Path& p, const Buffer& buf, MetadataCache* cache)
+{
+    // check and throw if needed
+    check_path_admitted<file_type::file_not_found,file_type::regular_file>(p, cache);
+
+    auto dir = boost::filesystem::path(p).parent_path().native();
+    auto f = open_unnamed(dir.empty() ? "." : dir);
+    if(!f) {
+        // unnamed files are not supported here: write a temporary file and rename it
+        auto temporary = temporary_name(p);
+        File t(temporary, O_WRONLY | O_CREAT | O_EXCL);
+        if(!t)
+            throw(ErrorCode(ErrorCode::open_failure, "writeFileAtomically was not able to open the file " + temporary + " in write mode"));
+        if(!inherit_attributes(t, p) || !t.write_at(buf.data(), buf.size(), 0) || !t.sync_data()) {
+            auto err = last_error();
+            unlink(temporary.c_str());
+            throw(ErrorCode(ErrorCode::write_failure, "writeFileAtomically was not able to write to the file " + temporary + ": " + err));
+        }
+        t.close();
+        if(rename(temporary.c_str(), p.c_str()) != 0) {
+            auto err = last_error();
+            unlink(temporary.c_str());
+            throw(ErrorCode(ErrorCode::write_failure, "writeFileAtomically was not able to rename the file " + temporary + " to " + p + ": " + err));
+        }
+        return;
+    }
 
-    if(!os)
-        throw(ErrorCode(ErrorCode::write_failure, std::string{__func__} + " was not able to write to the file " + p));
+    // the file replacing p keeps its permissions and owner
+    if(!inherit_attributes(f, p))
+        throw(ErrorCode(ErrorCode::write_failure, "writeFileAtomically was not able to set the permissions of " + p + ": " + last_error()));
+    if(!f.write_at(buf.data(), buf.size(), 0))
+        throw(ErrorCode(ErrorCode::write_failure, "writeFileAtomically was not able to write to an unnamed file in " + dir + ": " + last_error()));
+    // the content reaches the disk before the file is published, so that a crash cannot leave p empty or partial
+    if(!f.sync_data())
+        throw(ErrorCode(ErrorCode::write_failure, "writeFileAtomically was not able to sync an unnamed file in " + dir + ": " + last_error()));
+    if(!link_unnamed(f, p))
+        throw(ErrorCode(ErrorCode::write_failure, "writeFileAtomically was not able to link the file " + p + ": " + last_error()));
 }
 
 
 
 
-void appendToFile(const Path& p, const Buffer& bytes)
+static void appendToFile_(const Path& p, const Buffer& bytes, MetadataCache* cache)
 {
     // check and throw if needed
-    auto status = check_path_admitted<file_type::file_not_found,file_type::regular_file>(p);
+    check_path_admitted<file_type::file_not_found,file_type::regular_file>(p, cache);
 
-    auto flags = std::ios::binary | std::ios::out;
-    if(boost::filesystem::exists(status))
-         flags |= std::ios::ate| std::ios::in ;
-    std::basic_fstream<uint8_t> ios(p, flags);
-    if(!ios)
-        throw(ErrorCode(ErrorCode::open_failure, std::string{__func__} + " was not able to open the file " + p + " in read/write mode"));
+    File f(p, O_WRONLY | O_CREAT | O_APPEND);
+    if(!f)
+        throw(ErrorCode(ErrorCode::open_failure, "appendToFile was not able to open the file " + p + " in write mode"));
 
-    ios.imbue(utilities::utilities_locale);
-    ios.write(bytes.data(), bytes.size());
+    if(!f.write(bytes.data(), bytes.size()))
+        throw(ErrorCode(ErrorCode::append_failure, "appendToFile was not able to append to file " + p + ": " + last_error()));
+}
 
-    if(!ios)
-        throw(ErrorCode(ErrorCode::append_failure, std::string{__func__} + " was not able to append to file " + p + '\n'));
+void appendToFile(const Path& p, const Buffer& bytes)
+{
+    appendToFile_(p, bytes, nullptr);
+}
+
+
+/*
+ * Counterparts of readFile, writeFile and appendToFile on a descriptor already open in read-write mode,
+ * as kept by the workers' FileCache.
+ */
+static void readOpenFile_(const File& f, const Path& p, Buffer& ret)
+{
+    auto size = f.size();
+    if (size < 0)
+        throw(ErrorCode(ErrorCode::read_failure, "readFile was not able to get the size of the file " + p + ": " + last_error()));
+
+    ret.resize(size);
+    auto n = f.read_at(ret.data(), ret.size(), 0);
+    if (n != size)
+        throw(ErrorCode(ErrorCode::read_failure, "readFile was not able to read from the file " + p + ": " + last_error()));
+}
+
+static void writeOpenFile_(File& f, const Path& p, const Buffer& buf)
+{
+    if(!f.truncate(0) || !f.write_at(buf.data(), buf.size(), 0))
+        throw(ErrorCode(ErrorCode::write_failure, "writeFile was not able to write to the file " + p + ": " + last_error()));
+}
+
+// f is opened with O_APPEND: the bytes are written at the end of the file, whatever its current position
+static void appendToOpenFile_(File& f, const Path& p, const Buffer& bytes)
+{
+    if(!f.write(bytes.data(), bytes.size()))
+        throw(ErrorCode(ErrorCode::append_failure, "appendToFile was not able to append to file " + p + ": " + last_error()));
+}
+
+
+std::shared_ptr<const MappedRegion> mapFile(const Path& p)
+{
+    return std::make_shared<MappedRegion>(p);
 }
 
 
@@ -316,42 +449,72 @@ void appendToFile(const Path& p, const Buffer& bytes)
 
 bool FilesystemManager::exists(const Path& p)
 {
-    return filesystem::exists(p);
+    return exists_(p, metadata_.get());
 }
 
 
 bool FilesystemManager::removeFile(const Path& p)
 {
-    return filesystem::removeFile(p);
+    auto removed = removeFile_(p, metadata_.get());
+    forget(p);
+    return removed;
 }
 
 
 void FilesystemManager::move(const Path &from, const Path &to)
 {
-    return filesystem::move(from, to);
+    move_(from, to, metadata_.get());
+    // when to is a directory, from has been moved inside it: forgetting the paths below to covers it
+    forget(from);
+    forget(to);
 }
 
 
 void FilesystemManager::copyFile(const Path& from, const Path& to)
 {
-    return filesystem::copyFile(from, to);
+    copyFile_(from, to, metadata_.get());
+    forget(to);
 }
 
 void FilesystemManager::copyDirectory(const Path& from, const Path& to)
 {
-    return filesystem::copyDirectory(from, to);
+    try {
+        check_path_admitted<file_type::directory_file>(from, metadata_.get());
+        copyDirectory_(from, to);
+        forget(to);
+    }
+    catch(...) {
+        // part of the tree may have been copied anyway
+        forget(to);
+        throw;
+    }
 }
 
 
 uintmax_t FilesystemManager::removeDirectory(const Path& p)
 {
-    return filesystem::removeDirectory(p);
+    try {
+        auto removed = removeDirectory_(p, metadata_.get());
+        forget(p);
+        return removed;
+    }
+    catch(...) {
+        // part of the tree may have been removed anyway
+        forget(p);
+        throw;
+    }
 }
 
 
 bool FilesystemManager::createDirectory(const Path &p, bool parents)
 {
-    return filesystem::createDirectory(p, parents);
+    auto created = createDirectory_(p, parents, metadata_.get());
+    if(metadata_) {
+        // the missing parents have been created too
+        for(boost::filesystem::path ancestor{p}; !ancestor.empty(); ancestor = ancestor.parent_path())
+            metadata_->erase(ancestor.native());
+    }
+    return created;
 }
 
 
@@ -359,21 +522,68 @@ bool FilesystemManager::createDirectory(const Path &p, bool parents)
 
 Buffer FilesystemManager::readFile(const Path& p)
 {
-    return filesystem::readFile(p);
+    Buffer ret;
+    read_file(p, ret, false);
+    return ret;
 }
 
 
 
 
+void FilesystemManager::read_file(const Path& p, Buffer& buf, bool direct)
+{
+    if(direct)
+        readFileDirect(p, buf);
+    else
+        readFile_(p, buf, metadata_.get());
+}
+
+
 void FilesystemManager::writeFile(const Path& p, const Buffer& buf)
 {
-    return filesystem::writeFile(p, buf);
+    write_file(p, buf, false);
+}
+
+void FilesystemManager::write_file(const Path& p, const Buffer& buf, bool direct)
+{
+    try {
+        if(direct)
+            writeFileDirect(p, buf);
+        else
+            writeFile_(p, buf, metadata_.get());
+    }
+    catch(...) {
+        forget(p);
+        throw;
+    }
+    record_write(p, OperationCode::async_write, buf.size());
 }
 
 
 void FilesystemManager::appendToFile(const Path& p, const Buffer& bytes)
 {
-    return filesystem::appendToFile(p, bytes);
+    append_to_file(p, bytes, false);
+}
+
+void FilesystemManager::append_to_file(const Path& p, const Buffer& bytes, bool direct)
+{
+    try {
+        if(direct)
+            appendToFileDirect(p, bytes);
+        else
+            appendToFile_(p, bytes, metadata_.get());
+    }
+    catch(...) {
+        forget(p);
+        throw;
+    }
+    record_write(p, OperationCode::async_append, bytes.size());
+}
+
+
+std::shared_ptr<const MappedRegion> FilesystemManager::mapFile(const Path& p)
+{
+    return filesystem::mapFile(p);
 }
 
 
@@ -381,29 +591,350 @@ void FilesystemManager::appendToFile(const Path& p, const Buffer& bytes)
 
 void FilesystemManager::async_read(const Path& p, Buffer& buf, CompletionHandler h)
 {
-    // enque a read request to the waiting queue
-    q_.push_read(p, buf, std::move(h));
-    available_.set_event();
+    async_read(p, buf, std::move(h), Priority::normal);
+}
+
+void FilesystemManager::async_read(const Path& p, Buffer& buf, CompletionHandler h, Priority prio)
+{
+    // enque a read request to the waiting queue of the worker owning the path
+    submit(std::unique_ptr<Operation>(new ReadOperation(p, buf, std::move(h))), prio);
 }
 
 void FilesystemManager::async_read(std::unique_ptr<std::basic_ifstream<uint8_t>> fd, Buffer& buf, CompletionHandler h)
 {
-    q_.push_fd_read(std::move(fd), buf, std::move(h));
-    available_.set_event();
+    // the stream is not bound to any path: any worker is fine
+    enqueue(next_worker(), std::unique_ptr<Operation>(new StreamReadOperation(std::move(fd), buf, std::move(h))));
 }
 
 void FilesystemManager::async_write(const Path& p, const Buffer& buf, CompletionHandler h)
 {
-    // enqueue a write request to the waiting queue
-    q_.push_write(p, buf, std::move(h));
-    available_.set_event();
+    async_write(p, buf, std::move(h), Priority::normal);
+}
+
+void FilesystemManager::async_write(const Path& p, const Buffer& buf, CompletionHandler h, Priority prio)
+{
+    // enqueue a write request to the waiting queue of the worker owning the path
+    submit(std::unique_ptr<Operation>(new WriteOperation(OperationCode::async_write, p, buf, std::move(h))), prio);
 }
 
 
 
 void FilesystemManager::async_append(const Path&p, const Buffer &buf, FilesystemManagerInterface::CompletionHandler h) {
-    q_.push_append(p, buf, std::move(h));
-    available_.set_event();
+    async_append(p, buf, std::move(h), Priority::normal);
+}
+
+void FilesystemManager::async_append(const Path& p, const Buffer& buf, CompletionHandler h, Priority prio)
+{
+    submit(std::unique_ptr<Operation>(new WriteOperation(OperationCode::async_append, p, buf, std::move(h))), prio);
+}
+
+void FilesystemManager::async_read(const Path& p, Buffer& buf, CompletionHandler h, const SubmitOptions& opts)
+{
+    submit(std::unique_ptr<Operation>(new ReadOperation(p, buf, std::move(h))), opts);
+}
+
+void FilesystemManager::async_write(const Path& p, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts)
+{
+    submit(std::unique_ptr<Operation>(new WriteOperation(OperationCode::async_write, p, buf, std::move(h))), opts);
+}
+
+void FilesystemManager::async_append(const Path& p, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts)
+{
+    submit(std::unique_ptr<Operation>(new WriteOperation(OperationCode::async_append, p, buf, std::move(h))), opts);
+}
+
+void FilesystemManager::submit(std::unique_ptr<Operation> op, const SubmitOptions& opts)
+{
+    if(opts.token)
+        op->cancelled = opts.token->state;
+    op->deadline = opts.deadline;
+    // a read has nothing to make durable
+    if(op->code != OperationCode::async_read && op->code != OperationCode::async_readv && op->code != OperationCode::async_pread)
+        op->durability = opts.durability;
+    op->direct_io = opts.direct_io && (op->code == OperationCode::async_read || op->code == OperationCode::async_write
+                                       || op->code == OperationCode::async_append);
+    submit(std::move(op), opts.priority);
+}
+
+void FilesystemManager::submit(std::unique_ptr<Operation> op, Priority prio)
+{
+    if(max_queued_bytes_ || max_queued_operations_) {
+        auto bytes = queued_size(*op);
+        if(!admit(1, bytes)) {
+            io_.post(std::bind(std::move(op->handler), ErrorCode(ErrorCode::would_block, "too many operations queued: " + op->path + " refused"), size_t{0}));
+            return;
+        }
+        op->admitted = true;
+        op->admitted_bytes = bytes;
+    }
+    auto& w = worker_for(op->path);
+    enqueue(w, std::move(op), prio);
+}
+
+size_t FilesystemManager::queued_size(const Operation& op)
+{
+    if(op.code == OperationCode::async_write || op.code == OperationCode::async_append || op.code == OperationCode::async_write_atomic)
+        return static_cast<const WriteOperation&>(op).buf.size();
+    if(op.code == OperationCode::async_writev)
+        return static_cast<const GatherWriteOperation&>(op).size;
+    if(op.code == OperationCode::async_pwrite)
+        return static_cast<const PositionalWriteOperation&>(op).buf.size();
+    return 0;
+}
+
+bool FilesystemManager::is_short(const Operation& op)
+{
+    size_t size = 0;
+    switch(op.code) {
+    case OperationCode::async_write:
+    case OperationCode::async_append:
+    case OperationCode::async_write_atomic:
+    case OperationCode::async_writev:
+    case OperationCode::async_pwrite:
+        size = queued_size(op);
+        break;
+    case OperationCode::async_pread:
+        size = static_cast<const PositionalReadOperation&>(op).length;
+        break;
+    case OperationCode::async_readv:
+        for(const auto& iov : static_cast<const ScatterReadOperation&>(op).iov)
+            size += iov.iov_len;
+        break;
+    case OperationCode::async_read_chunk:
+        size = static_cast<const ChunkReadOperation&>(op).buf.size();
+        break;
+    default:
+        return false;
+    }
+    return size <= max_short_operation_size;
+}
+
+bool FilesystemManager::fits(size_t n, size_t bytes) const
+{
+    // when nothing is queued anything fits, so that no operation is refused forever
+    if(queued_operations_ == 0)
+        return true;
+    if(max_queued_operations_ && queued_operations_ + n > max_queued_operations_)
+        return false;
+    return !max_queued_bytes_ || queued_bytes_ + bytes <= max_queued_bytes_;
+}
+
+bool FilesystemManager::admit(size_t n, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(capacity_mutex_);
+    if(!fits(n, bytes))
+        return false;
+    queued_operations_ += n;
+    queued_bytes_ += bytes;
+    return true;
+}
+
+void FilesystemManager::release(size_t n, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(capacity_mutex_);
+    queued_operations_ -= n;
+    queued_bytes_ -= bytes;
+    // wake up the waiters in order, as long as there is room for them
+    while(!capacity_waiters_.empty() && fits(1, capacity_waiters_.front().first)) {
+        io_.post(std::bind(std::move(capacity_waiters_.front().second), ErrorCode{ErrorCode::success}, size_t{0}));
+        capacity_waiters_.pop_front();
+    }
+}
+
+void FilesystemManager::async_wait_capacity(size_t bytes, CompletionHandler h)
+{
+    {
+        std::lock_guard<std::mutex> lock(capacity_mutex_);
+        if(!fits(1, bytes) || !capacity_waiters_.empty()) {
+            capacity_waiters_.emplace_back(bytes, std::move(h));
+            return;
+        }
+    }
+    io_.post(std::bind(std::move(h), ErrorCode{ErrorCode::success}, size_t{0}));
+}
+
+size_t FilesystemManager::queued_operations()
+{
+    std::lock_guard<std::mutex> lock(capacity_mutex_);
+    return queued_operations_;
+}
+
+size_t FilesystemManager::queued_bytes()
+{
+    std::lock_guard<std::mutex> lock(capacity_mutex_);
+    return queued_bytes_;
+}
+
+void FilesystemManager::async_read(const Path& p, Buffer&& buf, BufferHandler h, const SubmitOptions& opts)
+{
+    // the buffer is kept alive by the completion handler, which hands it back to h
+    auto owned = std::make_shared<Buffer>(std::move(buf));
+    auto& dst = *owned;
+    async_read(p, dst, [owned, h](const ErrorCode& ec, size_t) { h(ec, std::move(*owned)); }, opts);
+}
+
+void FilesystemManager::async_write(const Path& p, Buffer&& buf, BufferHandler h, const SubmitOptions& opts)
+{
+    auto owned = std::make_shared<Buffer>(std::move(buf));
+    auto& src = *owned;
+    async_write(p, src, [owned, h](const ErrorCode& ec, size_t) { h(ec, std::move(*owned)); }, opts);
+}
+
+void FilesystemManager::async_append(const Path& p, Buffer&& buf, BufferHandler h, const SubmitOptions& opts)
+{
+    auto owned = std::make_shared<Buffer>(std::move(buf));
+    auto& src = *owned;
+    async_append(p, src, [owned, h](const ErrorCode& ec, size_t) { h(ec, std::move(*owned)); }, opts);
+}
+
+void FilesystemManager::async_write_atomic(const Path& p, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts)
+{
+    submit(std::unique_ptr<Operation>(new WriteOperation(OperationCode::async_write_atomic, p, buf, std::move(h))), opts);
+}
+
+void FilesystemManager::async_writev(const Path& p, const ConstBuffers& bufs, CompletionHandler h, const SubmitOptions& opts)
+{
+    submit(std::unique_ptr<Operation>(new GatherWriteOperation(p, bufs, std::move(h))), opts);
+}
+
+void FilesystemManager::async_readv(const Path& p, uint64_t offset, const MutableBuffers& bufs, CompletionHandler h, const SubmitOptions& opts)
+{
+    submit(std::unique_ptr<Operation>(new ScatterReadOperation(p, offset, bufs, std::move(h))), opts);
+}
+
+void FilesystemManager::async_pread(const Path& p, uint64_t offset, size_t length, Buffer& buf, CompletionHandler h, const SubmitOptions& opts)
+{
+    submit(std::unique_ptr<Operation>(new PositionalReadOperation(p, offset, length, buf, std::move(h))), opts);
+}
+
+void FilesystemManager::async_pwrite(const Path& p, uint64_t offset, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts)
+{
+    submit(std::unique_ptr<Operation>(new PositionalWriteOperation(p, offset, buf, std::move(h))), opts);
+}
+
+void FilesystemManager::async_copy_file(const Path& from, const Path& to, CompletionHandler h, Priority prio)
+{
+    // the copy is ordered with the other operations on the source file
+    enqueue(worker_for(from), std::unique_ptr<Operation>(new CopyOperation(from, to, true, std::move(h))), prio);
+}
+
+void FilesystemManager::async_copy_directory(const Path& from, const Path& to, CompletionHandler h, ProgressHandler progress, size_t max_in_flight, Priority prio)
+{
+    auto job = std::make_shared<DirectoryCopy>(max_in_flight ? max_in_flight : 4 * workers_.size(), prio, std::move(h), std::move(progress));
+    auto& files = job->files;
+    enqueue(worker_for(from), std::unique_ptr<Operation>(new DirectoryScanOperation(from, to, files, [this, job](const ErrorCode& ec, size_t) {
+        if(ec) {
+            job->handler(ec, 0);
+            return;
+        }
+        job->progress.files_total = job->files.size();
+        for(const auto& f : job->files)
+            job->progress.bytes_total += f.size;
+        copy_next_files(job);
+    })), prio);
+}
+
+void FilesystemManager::async_batch(const std::vector<BatchOperation>& ops, BatchHandler h, Priority prio)
+{
+    if(ops.empty()) {
+        io_.post(std::bind(std::move(h), ErrorCode{ErrorCode::success}, std::vector<BatchResult>{}));
+        return;
+    }
+
+    const bool limited = max_queued_bytes_ || max_queued_operations_;
+    if(limited) {
+        size_t bytes = 0;
+        for(const auto& b : ops)
+            bytes += b.kind == BatchOperation::Kind::read ? 0 : b.src->size();
+        if(!admit(ops.size(), bytes)) {
+            ErrorCode ec{ErrorCode::would_block, "too many operations queued: batch refused"};
+            io_.post(std::bind(std::move(h), ec, std::vector<BatchResult>(ops.size(), BatchResult{ec, 0})));
+            return;
+        }
+    }
+
+    auto batch = std::make_shared<Batch>(ops.size(), std::move(h));
+    std::vector<std::vector<std::unique_ptr<Operation>>> assigned(workers_.size());
+    for(size_t i = 0; i < ops.size(); ++i) {
+        const auto& b = ops[i];
+        auto done = [this, batch, i](const ErrorCode& ec, size_t size) {
+            batch->results[i] = BatchResult{ec, size};
+            if(--batch->remaining > 0)
+                return;
+            io_.post([batch]() {
+                auto failed = std::find_if(batch->results.begin(), batch->results.end(), [](const BatchResult& r) { return bool(r.ec); });
+                batch->handler(failed == batch->results.end() ? ErrorCode{ErrorCode::success} : failed->ec, batch->results);
+            });
+        };
+        std::unique_ptr<Operation> op;
+        switch(b.kind) {
+        case BatchOperation::Kind::read:
+            op.reset(new ReadOperation(b.path, *b.dst, std::move(done)));
+            break;
+        case BatchOperation::Kind::write:
+            op.reset(new WriteOperation(OperationCode::async_write, b.path, *b.src, std::move(done)));
+            break;
+        case BatchOperation::Kind::append:
+            op.reset(new WriteOperation(OperationCode::async_append, b.path, *b.src, std::move(done)));
+            break;
+        }
+        op->priority = prio;
+        op->batched = true;
+        if(limited) {
+            op->admitted = true;
+            op->admitted_bytes = queued_size(*op);
+        }
+        mark_enqueued(*op);
+        assigned[worker_index(b.path)].push_back(std::move(op));
+    }
+
+    for(size_t i = 0; i < assigned.size(); ++i) {
+        if(assigned[i].empty())
+            continue;
+        workers_[i]->push(std::move(assigned[i]), prio);
+        wake(*workers_[i]);
+    }
+}
+
+void FilesystemManager::copy_next_files(std::shared_ptr<DirectoryCopy> job)
+{
+    while(!job->ec && job->next < job->files.size() && job->in_flight < job->max_in_flight) {
+        const auto& f = job->files[job->next++];
+        ++job->in_flight;
+        // files are spread on the workers according to their path
+        enqueue(worker_for(f.from), std::unique_ptr<Operation>(new CopyOperation(f.from, f.to, false, [this, job, &f](const ErrorCode& ec, size_t) {
+            --job->in_flight;
+            if(ec) {
+                if(!job->ec)
+                    job->ec = ec;
+            }
+            else {
+                ++job->progress.files_copied;
+                job->progress.bytes_copied += f.size;
+                if(job->on_progress)
+                    job->on_progress(job->progress);
+            }
+            copy_next_files(job);
+        })), job->priority);
+    }
+
+    if(job->in_flight == 0 && (job->ec || job->next == job->files.size()))
+        job->handler(job->ec, job->progress.bytes_copied);
+}
+
+void FilesystemManager::async_map_file(const Path& p, MapHandler h, Priority prio)
+{
+    // the region is handed from the worker to the completion handler through a shared slot
+    auto region = std::make_shared<std::shared_ptr<const MappedRegion>>();
+    auto& dst = *region;
+    enqueue(worker_for(p), std::unique_ptr<Operation>(new MapOperation(p, dst, [region, h](const ErrorCode& ec, size_t) { h(ec, std::move(*region)); })), prio);
+}
+
+void FilesystemManager::async_read_chunk(std::shared_ptr<impl::ChunkedReader> r, size_t pos, impl::HotDoubleBuffer::BufferView& buf, CompletionHandler h)
+{
+    // enque a read request to the waiting queue of the worker owning the path
+    auto& w = worker_for(r->file_path());
+    enqueue(w, std::unique_ptr<Operation>(new ChunkReadOperation(r, pos, buf, std::move(h))));
 }
 
 
@@ -413,91 +944,490 @@ void FilesystemManager::async_append(const Path&p, const Buffer &buf, Filesystem
  * class FilesystemManager implementation
  */
 
-FilesystemManager::FilesystemManager(boost::asio::io_service& io)
+static FilesystemManager::Options make_options(size_t n_workers, FilesystemManager::Backend backend)
+{
+    FilesystemManager::Options options;
+    options.workers = n_workers;
+    options.backend = backend;
+    return options;
+}
+
+FilesystemManager::FilesystemManager(boost::asio::io_service& io, size_t n_workers, Backend backend)
+: FilesystemManager(io, make_options(n_workers, backend))
+{}
+
+FilesystemManager::FilesystemManager(boost::asio::io_service& io, const Options& options)
 : io_(io)
+, backend_(options.backend)
+, priority_aging_(options.priority_aging)
+, sync_window_(options.sync_window)
+, stats_(options.metrics ? new std::array<OperationStats, n_operation_codes> : nullptr)
+, queue_depth_(0)
+, bytes_in_flight_(0)
+, metadata_(options.metadata_ttl > std::chrono::milliseconds::zero() ? new MetadataCache(options.metadata_ttl) : nullptr)
+, max_queued_bytes_(options.max_queued_bytes)
+, max_queued_operations_(options.max_queued_operations)
+, queued_bytes_(0)
+, queued_operations_(0)
 , done_(false)
-, thrd_(FilesystemManager::process_queue,std::ref(*this))
-{}
+, next_worker_(0)
+{
+    if(options.workers == 0)
+        throw std::invalid_argument("[ERROR] FilesystemManager: at least one worker thread is needed.");
+    if(options.priority_aging == 0)
+        throw std::invalid_argument("[ERROR] FilesystemManager: the priority aging must be at least 1.");
+
+    // create all the workers before starting them, since worker_for() relies on the final number of workers
+    workers_.reserve(options.workers);
+    for(size_t i = 0; i < options.workers; ++i) {
+        workers_.emplace_back(new Worker);
+        if(backend_ == Backend::io_uring)
+            workers_.back()->uring.reset(new UringContext);
+        else if(options.fd_cache_size > 0)
+            workers_.back()->files.reset(new FileCache(options.fd_cache_size));
+    }
+    for(auto& w : workers_)
+        w->thrd = std::thread(FilesystemManager::process_queue, std::ref(*this), std::ref(*w));
+}
 
-void FilesystemManager::process_queue(FilesystemManager& fs)
+void FilesystemManager::process_queue(FilesystemManager& fs, Worker& w)
 {
+    if(w.uring)
+        return w.uring->run(fs, w);
+
     // while the object isn't destroyed/stopped
     while(!fs.done_) {
-        // wait on the queue for an operation to be available
-        fs.available_.wait_event();
-        fs.available_.reset_event();
-        while(!fs.q_.empty()) {
-            // execute the operation
-            fs.perform_next_operation();
+        // wait on the queue for an operation to be available; operations pushed while the worker is busy
+        // make it return at once, without being lost
+        w.wakeup.wait();
+        resume_parked(w);
+        auto op = w.pop(fs.priority_aging_);
+        while(op) {
+            bool short_next = is_short(*op);
+            std::vector<std::unique_ptr<Operation>> appends;
+            if(op->code == OperationCode::async_append && !op->direct_io) {
+                // gather the appends to the same path that follow, to perform all of them with a single write
+                size_t gathered = queued_size(*op);
+                appends.push_back(std::move(op));
+                op = w.pop(fs.priority_aging_);
+                while(op && op->code == OperationCode::async_append && !op->direct_io && op->path == appends.front()->path
+                      && appends.size() < max_coalesced_appends) {
+                    gathered += queued_size(*op);
+                    appends.push_back(std::move(op));
+                    op = w.pop(fs.priority_aging_);
+                }
+                short_next = gathered <= max_short_operation_size;
+            }
+            // the syncs wait for more writes to share them, and the handlers for others to be posted along with them,
+            // only while the next operation is short: a long one would hold them well beyond their windows
+            fs.sync_pending(w, !short_next);
+            fs.flush_completions(w, !short_next);
+            if(!appends.empty()) {
+                fs.perform_appends(w, appends);
+                continue;
+            }
+            // execute the operation: a chunk read may let a parked one start
+            fs.perform_operation(w, std::move(op));
+            resume_parked(w);
+            op = w.pop(fs.priority_aging_);
         }
+        // nothing else to do: there is no point in waiting for more operations to share the syncs
+        // or for more handlers to be posted together
+        fs.sync_pending(w, true);
+        fs.flush_completions(w, true);
     }
 }
 
 FilesystemManager::~FilesystemManager()
 {
-    // set the completion flag to true, notify the event and wait for the working thread to finish
+    // set the completion flag to true, notify the events and wait for the working threads to finish
     done_ = true;
-    available_.set_event();
-    thrd_.join();
+    for(auto& w : workers_) {
+        wake(*w);
+        w->thrd.join();
+    }
 }
 
 
-void FilesystemManager::perform_next_operation()
+void FilesystemManager::enqueue(Worker& w, std::unique_ptr<Operation> op, Priority prio)
 {
-    using std::get;
+    op->priority = prio;
+    mark_enqueued(*op);
+    w.push(std::move(op));
+    wake(w);
+}
+
+void FilesystemManager::wake(Worker& w)
+{
+    // a busy worker is only marked as notified: it finds the new operations before sleeping again,
+    // so that only a sleeping one costs a system call
+    if(!w.uring)
+        w.wakeup.notify();
+    else if(w.wakeup.signal())
+        w.uring->notify();
+}
 
-    CompletionHandler h;
+
+std::shared_ptr<File> FilesystemManager::cached_file(Worker& w, const Path& p, bool create, bool append)
+{
+    return w.files ? w.files->acquire(p, create, append) : nullptr;
+}
+
+void FilesystemManager::forget(const Path& p)
+{
+    for(auto& w : workers_)
+        if(w->files)
+            w->files->invalidate(p);
+    if(metadata_)
+        metadata_->invalidate(p);
+}
+
+void FilesystemManager::record_write(const Path& p, OperationCode code, uintmax_t size)
+{
+    if(!metadata_)
+        return;
+    if(code == OperationCode::async_append)
+        metadata_->grown(p, size);
+    else
+        metadata_->store(p, Metadata{file_type::regular_file, size});
+}
+
+uintmax_t FilesystemManager::file_size(const Path& p)
+{
+    if(metadata_) {
+        try {
+            auto m = metadata_->lookup(p);
+            if(m.type == file_type::regular_file)
+                return m.size;
+        }
+        catch(const ErrorCode&) {}
+    }
+    boost::system::error_code err;
+    auto size = boost::filesystem::file_size(p, err);
+    return err ? 0 : size;
+}
+
+
+std::unique_ptr<FilesystemManager::Operation> FilesystemManager::Worker::pop(size_t aging)
+{
+    for(size_t c = 0; c < n_priorities; ++c) {
+        while(auto op = q[c].pop()) {
+            if(!op->path.empty())
+                waiting_on[op->path].emplace(op->sequence, c);
+            waiting[c].push_back(std::move(op));
+        }
+    }
+
+    // the front of a class can go only if no operation on the same path submitted before it is waiting in another class
+    std::array<bool, n_priorities> ready{};
+    bool any = false;
+    for(size_t c = 0; c < n_priorities; ++c) {
+        if(waiting[c].empty())
+            continue;
+        const auto& op = *waiting[c].front();
+        ready[c] = true;
+        if(!op.path.empty()) {
+            const auto& on_path = waiting_on[op.path];
+            for(auto it = on_path.begin(); it != on_path.end() && it->first < op.sequence && ready[c]; ++it)
+                ready[c] = it->second == c;
+        }
+        any = any || ready[c];
+    }
+    // every front waits for another one only if different threads submitted operations on the same paths
+    // concurrently, in which case there is no submission order to keep
+    if(!any)
+        for(size_t c = 0; c < n_priorities; ++c)
+            ready[c] = !waiting[c].empty();
+
+    // an operation of a lower class that has been overtaken too many times goes first, the lowest class first
+    size_t chosen = n_priorities;
+    for(size_t c = n_priorities - 1; c > 0; --c) {
+        if(ready[c] && overtaken[c] >= aging) {
+            chosen = c;
+            break;
+        }
+    }
+    // otherwise the highest class waiting
+    for(size_t c = 0; c < n_priorities && chosen == n_priorities; ++c)
+        if(ready[c])
+            chosen = c;
+    if(chosen == n_priorities)
+        return nullptr;
+
+    for(size_t c = chosen + 1; c < n_priorities; ++c)
+        if(!waiting[c].empty())
+            ++overtaken[c];
+    overtaken[chosen] = 0;
+
+    auto op = std::move(waiting[chosen].front());
+    waiting[chosen].pop_front();
+    if(!op->path.empty()) {
+        auto it = waiting_on.find(op->path);
+        it->second.erase(op->sequence);
+        if(it->second.empty())
+            waiting_on.erase(it);
+    }
+    return op;
+}
+
+
+bool FilesystemManager::park(Worker& w, std::unique_ptr<Operation>& op)
+{
+    if(op->code != OperationCode::async_read_chunk)
+        return false;
+    const auto& t = static_cast<const ChunkReadOperation&>(*op);
+    if(t.reader->ready(t.pos, t.buf))
+        return false;
+    w.parked.push_back(std::move(op));
+    return true;
+}
+
+void FilesystemManager::resume_parked(Worker& w)
+{
+    for(auto it = w.parked.begin(); it != w.parked.end();) {
+        const auto& t = static_cast<const ChunkReadOperation&>(**it);
+        if(t.reader->ready(t.pos, t.buf)) {
+            w.push(std::move(*it));
+            it = w.parked.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+void FilesystemManager::perform_appends(Worker& w, std::vector<std::unique_ptr<Operation>>& ops)
+{
+    for(auto& op : ops) {
+        mark_started(*op);
+        discard_stopped(w, op);
+    }
+    ops.erase(std::remove(ops.begin(), ops.end(), nullptr), ops.end());
+    if(ops.empty())
+        return;
+    if(ops.size() == 1)
+        return perform_operation(w, std::move(ops.front()));
+
+    const auto& p = ops.front()->path;
+    std::vector<struct iovec> iov;
+    iov.reserve(ops.size());
+    size_t total = 0;
+    for(const auto& op : ops) {
+        const auto& buf = static_cast<WriteOperation&>(*op).buf;
+        iov.push_back({const_cast<uint8_t*>(buf.data()), buf.size()});
+        total += buf.size();
+    }
+
+    ErrorCode ec{ErrorCode::success};
+    size_t written = 0;
+    try {
+        File opened;
+        auto cached = cached_file(w, p, true, true);
+        if(!cached) {
+            // check and throw if needed
+            check_path_admitted<file_type::file_not_found,file_type::regular_file>(p, metadata_.get());
+            opened = File(p, O_WRONLY | O_CREAT | O_APPEND);
+            if(!opened)
+                throw ErrorCode(ErrorCode::open_failure, "async_append was not able to open the file " + p + " in write mode");
+        }
+        auto& f = cached ? *cached : opened;
+        written = f.writev(iov.data(), iov.size());
+        if(written != total)
+            ec = ErrorCode(ErrorCode::append_failure, "async_append was not able to append to file " + p + ": " + last_error());
+    }
+    catch(const ErrorCode& e) {
+        ec = e;
+    }
+    if(written == total)
+        record_write(p, OperationCode::async_append, written);
+    else
+        forget(p);
+
+    // the appends entirely written are successful, the others share the error
+    size_t end = 0;
+    for(auto& op : ops) {
+        const auto size = static_cast<WriteOperation&>(*op).buf.size();
+        end += size;
+        if(end <= written)
+            complete(w, *op, std::move(op->handler), ErrorCode{ErrorCode::success}, size);
+        else
+            complete(w, *op, std::move(op->handler), ec, size_t{0});
+    }
+}
+
+
+void FilesystemManager::perform_operation(Worker& w, std::unique_ptr<Operation> op)
+{
+    if(park(w, op))
+        return;
+    mark_started(*op);
+    if(discard_stopped(w, op))
+        return;
+
+    CompletionHandler h = std::move(op->handler);
     ErrorCode ec{ErrorCode::unknown_error};
     size_t size{0};
 
     try {
-        switch (q_.front()) {
+        switch (op->code) {
         case OperationCode::async_read: {
-            std::tuple<OperationCode,const Path,std::reference_wrapper<Buffer>,CompletionHandler> t = q_.pop_read();
-            std::reference_wrapper<Buffer> tmp = std::get<2>(t);
-            auto &buf = tmp.get();
-            h = std::move(std::get<3>(t));
-            buf = filesystem::readFile(std::get<1>(t));
+            auto& buf = static_cast<ReadOperation&>(*op).buf;
+            auto f = op->direct_io ? nullptr : cached_file(w, op->path, false);
+            if(f)
+                readOpenFile_(*f, op->path, buf);
+            else
+                read_file(op->path, buf, op->direct_io);
             ec = ErrorCode::success;
             size = buf.size();
         }
             break;
         case OperationCode::async_write: {
-            std::tuple<OperationCode,const Path,std::reference_wrapper<const Buffer>,CompletionHandler> t = q_.pop_write();
-            const auto& buf = get<2>(t).get();
-            h = std::move(get<3>(t));
-            filesystem::writeFile(get<1>(t), buf);
+            const auto& buf = static_cast<WriteOperation&>(*op).buf;
+            auto f = op->direct_io ? nullptr : cached_file(w, op->path, true);
+            if(f) {
+                try {
+                    writeOpenFile_(*f, op->path, buf);
+                }
+                catch(...) {
+                    forget(op->path);
+                    throw;
+                }
+                record_write(op->path, op->code, buf.size());
+            }
+            else
+                write_file(op->path, buf, op->direct_io);
             ec = ErrorCode::success;
             size = buf.size();
         }
             break;
         case OperationCode::async_append: {
-            auto t = q_.pop_write();
-            const auto &buf = get<2>(t).get();
-            h = std::move(get<3>(t));
-            filesystem::appendToFile(get<1>(t), buf);
+            const auto& buf = static_cast<WriteOperation&>(*op).buf;
+            auto f = op->direct_io ? nullptr : cached_file(w, op->path, true, true);
+            if(f) {
+                try {
+                    appendToOpenFile_(*f, op->path, buf);
+                }
+                catch(...) {
+                    forget(op->path);
+                    throw;
+                }
+                record_write(op->path, op->code, buf.size());
+            }
+            else
+                append_to_file(op->path, buf, op->direct_io);
+            ec = ErrorCode::success;
+            size = buf.size();
+        } break;
+        case OperationCode::async_write_atomic: {
+            const auto& buf = static_cast<WriteOperation&>(*op).buf;
+            try {
+                writeFileAtomically_(op->path, buf, metadata_.get());
+            }
+            catch(...) {
+                forget(op->path);
+                throw;
+            }
+            // p is a new file now: the descriptor of the former one must not be used anymore
+            forget(op->path);
+            record_write(op->path, OperationCode::async_write, buf.size());
             ec = ErrorCode::success;
             size = buf.size();
         } break;
+        case OperationCode::async_writev: {
+            auto& t = static_cast<GatherWriteOperation&>(*op);
+            auto f = cached_file(w, op->path, true);
+            File opened;
+            try {
+                if(!f) {
+                    // check and throw if needed
+                    check_path_admitted<file_type::file_not_found,file_type::regular_file>(op->path, metadata_.get());
+                    opened = File(op->path, O_WRONLY | O_CREAT | O_TRUNC);
+                    if(!opened)
+                        throw ErrorCode(ErrorCode::open_failure, "async_writev was not able to open the file " + op->path + " in write mode");
+                }
+                else if(!f->truncate(0))
+                    throw ErrorCode(ErrorCode::write_failure, "async_writev was not able to truncate the file " + op->path + ": " + last_error());
+                auto& file = f ? *f : opened;
+                if(file.writev_at(t.iov.data(), static_cast<int>(t.iov.size()), 0) != t.size)
+                    throw ErrorCode(ErrorCode::write_failure, "async_writev was not able to write to the file " + op->path + ": " + last_error());
+            }
+            catch(...) {
+                forget(op->path);
+                throw;
+            }
+            record_write(op->path, OperationCode::async_write, t.size);
+            ec = ErrorCode::success;
+            size = t.size;
+        } break;
+        case OperationCode::async_readv: {
+            auto& t = static_cast<ScatterReadOperation&>(*op);
+            auto f = cached_file(w, op->path, false);
+            File opened;
+            if(!f) {
+                // check and throw if needed
+                check_path_admitted<file_type::regular_file, file_type::symlink_file>(op->path, metadata_.get());
+                opened = File(op->path, O_RDONLY);
+                if(!opened)
+                    throw ErrorCode(ErrorCode::open_failure, "async_readv was not able to open the file " + op->path + " in read mode");
+            }
+            auto n = (f ? *f : opened).readv_at(t.iov.data(), static_cast<int>(t.iov.size()), t.offset);
+            if(n < 0)
+                throw ErrorCode(ErrorCode::read_failure, "async_readv was not able to read from the file " + op->path + ": " + last_error());
+            ec = ErrorCode::success;
+            size = n;
+        } break;
+        case OperationCode::async_pread: {
+            auto& t = static_cast<PositionalReadOperation&>(*op);
+            auto f = cached_file(w, op->path, false);
+            File opened;
+            if(!f) {
+                // check and throw if needed
+                check_path_admitted<file_type::regular_file, file_type::symlink_file>(op->path, metadata_.get());
+                opened = File(op->path, O_RDONLY);
+                if(!opened)
+                    throw ErrorCode(ErrorCode::open_failure, "async_pread was not able to open the file " + op->path + " in read mode");
+            }
+            t.buf.resize(t.length);
+            struct iovec iov{t.buf.data(), t.length};
+            auto n = (f ? *f : opened).readv_at(&iov, 1, t.offset);
+            if(n < 0) {
+                t.buf.clear();
+                throw ErrorCode(ErrorCode::read_failure, "async_pread was not able to read from the file " + op->path + ": " + last_error());
+            }
+            t.buf.resize(n);
+            ec = ErrorCode::success;
+            size = n;
+        } break;
+        case OperationCode::async_pwrite: {
+            auto& t = static_cast<PositionalWriteOperation&>(*op);
+            auto f = cached_file(w, op->path, true);
+            File opened;
+            if(!f) {
+                // check and throw if needed
+                check_path_admitted<file_type::file_not_found,file_type::regular_file>(op->path, metadata_.get());
+                opened = File(op->path, O_WRONLY | O_CREAT);
+                if(!opened)
+                    throw ErrorCode(ErrorCode::open_failure, "async_pwrite was not able to open the file " + op->path + " in write mode");
+            }
+            struct iovec iov{const_cast<uint8_t*>(t.buf.data()), t.buf.size()};
+            auto n = (f ? *f : opened).writev_at(&iov, 1, t.offset);
+            // the new size depends on the old one, which is not known here
+            if(metadata_)
+                metadata_->erase(op->path);
+            if(n != t.buf.size())
+                throw ErrorCode(ErrorCode::write_failure, "async_pwrite was not able to write to the file " + op->path + ": " + last_error());
+            ec = ErrorCode::success;
+            size = n;
+        } break;
         case OperationCode::async_read_chunk: {
-            std::tuple<OperationCode,std::shared_ptr<impl::ChunkedReader>,size_t,impl::HotDoubleBuffer::BufferView,CompletionHandler>  t = q_.pop_chunked_read();
-            auto pos = get<2>(t);
-            h = std::move(get<4>(t));
-            auto reader = get<1>(t);
+            auto& t = static_cast<ChunkReadOperation&>(*op);
+            auto pos = t.pos;
+            auto& reader = t.reader;
             // check that the reader has not been stopped
             if(reader->is_stopped()) {
                 ec = ErrorCode::stopped;
                 break;
             }
-            // check that the number of buff
-            auto buf = get<3>(t);
-            // if this is not the next chunk to be read or the buffer is full
-            if(reader->bytes_read() != pos || buf.is_hot()) {
-                // enque the current operation at the end
-                q_.push_chunked_read(reader, pos, buf, std::move(h));
-                return;
-            }
-
+            auto& buf = t.buf;
             auto size_to_read = buf.size();
             reader->read_file_chunk(buf, buf.size(), pos);
             buf.set_hot(true);
@@ -505,13 +1435,40 @@ void FilesystemManager::perform_next_operation()
             size = buf.size();
         } break;
         case OperationCode::fd_async_read: {
-            std::tuple<OperationCode, std::unique_ptr<std::basic_ifstream<uint8_t>>, std::reference_wrapper<Buffer>,CompletionHandler> t = q_.pop_fd_read();
-            std::reference_wrapper<Buffer> tmp = std::get<2>(t);
-            auto &buf = tmp.get();
-            h = std::move(std::get<3>(t));
-            buf = filesystem::readFile(std::move(std::get<1>(t)));
+            auto& t = static_cast<StreamReadOperation&>(*op);
+            t.buf = filesystem::readFile(std::move(t.in));
+            ec = ErrorCode::success;
+            size = t.buf.size();
+        } break;
+        case OperationCode::async_map_file: {
+            auto& region = static_cast<MapOperation&>(*op).region;
+            region = FilesystemManager::mapFile(op->path);
+            ec = ErrorCode::success;
+            size = region->size();
+        } break;
+        case OperationCode::async_copy_file: {
+            auto& t = static_cast<CopyOperation&>(*op);
+            if(t.overwrite)
+                FilesystemManager::copyFile(op->path, t.to);
+            else {
+                copyFile_(op->path, t.to, false);
+                forget(t.to);
+            }
+            ec = ErrorCode::success;
+            size = file_size(op->path);
+        } break;
+        case OperationCode::async_copy_directory: {
+            auto& t = static_cast<DirectoryScanOperation&>(*op);
+            check_path_admitted<file_type::directory_file>(op->path, metadata_.get());
+            try {
+                makeDirectoryTree_(op->path, t.to, t.files);
+            }
+            catch(...) {
+                forget(t.to);
+                throw;
+            }
+            forget(t.to);
             ec = ErrorCode::success;
-            size = buf.size();
         } break;
 
         default:
@@ -524,9 +1481,238 @@ void FilesystemManager::perform_next_operation()
     }
 
     // post the completion handler to the boost asio io_service
-    io_.post(std::bind(std::move(h), ec, size));
+    complete(w, *op, std::move(h), ec, size);
 }
 
+bool FilesystemManager::discard_stopped(Worker& w, std::unique_ptr<Operation>& op)
+{
+    const char* reason = nullptr;
+    if(op->cancelled && op->cancelled->load(std::memory_order_relaxed))
+        reason = " has been cancelled";
+    else if(op->deadline != Deadline::max() && std::chrono::steady_clock::now() >= op->deadline)
+        reason = " has missed its deadline";
+    if(!reason)
+        return false;
+
+    complete(w, *op, std::move(op->handler), ErrorCode(ErrorCode::stopped, "the operation on " + op->path + reason), 0);
+    op.reset();
+    return true;
+}
+
+void FilesystemManager::complete(Worker& w, const Operation& op, CompletionHandler h, const ErrorCode& ec, size_t size)
+{
+    if(op.durability != Durability::none && ec == ErrorCode::success) {
+        if(w.syncs.empty())
+            w.sync_due = std::chrono::steady_clock::now() + sync_window_;
+        w.syncs.push_back(PendingSync{op.path, op.durability, std::move(h), size, op.admitted, op.admitted_bytes, op.code, op.probe});
+        return;
+    }
+    deliver(w, op.code, op.path, op.probe, op.batched, std::move(h), ec, size);
+    if(stats_)
+        bytes_in_flight_ -= op.admitted_bytes;
+    // the handlers waiting for capacity come after the one of the operation: the room is released by flush_completions
+    if(op.admitted) {
+        ++w.released_operations;
+        w.released_bytes += op.admitted_bytes;
+    }
+}
+
+void FilesystemManager::deliver(Worker& w, OperationCode code, const Path& path, const Probe& probe, bool batched, CompletionHandler h, const ErrorCode& ec, size_t size)
+{
+    if(!batched && w.completed.empty())
+        w.completed_since = std::chrono::steady_clock::now();
+    if(!stats_ && !probe.trace_id) {
+        if(batched)
+            h(ec, size);
+        else
+            w.completed.push_back(std::bind(std::move(h), ec, size));
+        return;
+    }
+
+    auto stats = stats_ ? &(*stats_)[static_cast<size_t>(code)] : nullptr;
+    auto ended = std::chrono::steady_clock::now();
+    if(stats && probe.started != std::chrono::steady_clock::time_point{})
+        stats->execution.record(ended - probe.started);
+    if(probe.trace_id)
+        trace(probe.trace_id, probe.trace_parent, operation_name(code), TracePhase::end, path);
+    if(batched) {
+        if(stats)
+            stats->dispatch.record(std::chrono::nanoseconds::zero());
+        if(probe.trace_id)
+            trace(probe.trace_id, probe.trace_parent, operation_name(code), TracePhase::complete, path);
+        h(ec, size);
+        return;
+    }
+    // the path is needed only by the observer
+    Path traced = probe.trace_id ? path : Path{};
+    w.completed.push_back(std::bind([stats, ended, probe, code, traced](CompletionHandler& h, const ErrorCode& ec, size_t size) {
+        if(stats)
+            stats->dispatch.record(std::chrono::steady_clock::now() - ended);
+        if(probe.trace_id)
+            trace(probe.trace_id, probe.trace_parent, operation_name(code), TracePhase::complete, traced);
+        h(ec, size);
+    }, std::move(h), ec, size));
+}
+
+// longest time a completion handler waits for others to be posted along with it
+static constexpr std::chrono::microseconds max_completion_delay{100};
+
+/*
+ * Run in order the handlers from first on; if one of them throws, the following ones are posted again
+ * before the exception leaves the io_service, as if each had been posted on its own.
+ */
+static void run_completions(boost::asio::io_service& io, std::vector<std::function<void()>>& handlers, size_t first = 0)
+{
+    for(size_t i = first; i < handlers.size(); ++i) {
+        try {
+            handlers[i]();
+        }
+        catch(...) {
+            if(i + 1 < handlers.size())
+                io.post(std::bind([&io](std::vector<std::function<void()>>& rest) { run_completions(io, rest); },
+                                  std::vector<std::function<void()>>(std::make_move_iterator(handlers.begin() + i + 1),
+                                                                     std::make_move_iterator(handlers.end()))));
+            throw;
+        }
+    }
+}
+
+void FilesystemManager::flush_completions(Worker& w, bool force)
+{
+    if(!w.completed.empty()) {
+        if(!force && w.completed.size() < max_batched_completions
+                && std::chrono::steady_clock::now() - w.completed_since < max_completion_delay)
+            return;
+        auto& io = io_;
+        if(w.completed.size() == 1)
+            io_.post(std::move(w.completed.front()));
+        else
+            io_.post(std::bind([&io](std::vector<std::function<void()>>& handlers) { run_completions(io, handlers); }, std::move(w.completed)));
+        w.completed.clear();
+    }
+    if(w.released_operations) {
+        release(w.released_operations, w.released_bytes);
+        w.released_operations = 0;
+        w.released_bytes = 0;
+    }
+}
+
+void FilesystemManager::mark_enqueued(Operation& op)
+{
+    if(trace_observer()) {
+        op.probe.trace_id = next_trace_id();
+        op.probe.trace_parent = TraceScope::current();
+        trace(op.probe.trace_id, op.probe.trace_parent, operation_name(op.code), TracePhase::enqueue, op.path);
+    }
+    if(!stats_)
+        return;
+    op.probe.enqueued = std::chrono::steady_clock::now();
+    if(!op.admitted)
+        op.admitted_bytes = queued_size(op);
+    ++queue_depth_;
+    bytes_in_flight_ += op.admitted_bytes;
+}
+
+void FilesystemManager::mark_started(Operation& op)
+{
+    if((!stats_ && !op.probe.trace_id) || op.probe.started != std::chrono::steady_clock::time_point{})
+        return;
+    op.probe.started = std::chrono::steady_clock::now();
+    if(op.probe.trace_id)
+        trace(op.probe.trace_id, op.probe.trace_parent, operation_name(op.code), TracePhase::start, op.path);
+    if(!stats_)
+        return;
+    --queue_depth_;
+    (*stats_)[static_cast<size_t>(op.code)].queue_wait.record(op.probe.started - op.probe.enqueued);
+}
+
+FilesystemManager::Metrics FilesystemManager::metrics() const
+{
+    Metrics m;
+    if(!stats_)
+        return m;
+    for(size_t i = 0; i < n_operation_codes; ++i) {
+        const auto& stats = (*stats_)[i];
+        auto queue_wait = stats.queue_wait.snapshot();
+        if(queue_wait.count == 0)
+            continue;
+        m.operations.emplace(operation_name(static_cast<OperationCode>(i)), OperationMetrics{std::move(queue_wait), stats.execution.snapshot(), stats.dispatch.snapshot()});
+    }
+    m.queue_depth = queue_depth_;
+    m.bytes_in_flight = bytes_in_flight_;
+    return m;
+}
+
+const char* FilesystemManager::operation_name(OperationCode code)
+{
+    switch(code) {
+    case OperationCode::async_read: return "async_read";
+    case OperationCode::async_write: return "async_write";
+    case OperationCode::async_read_chunk: return "async_read_chunk";
+    case OperationCode::async_append: return "async_append";
+    case OperationCode::fd_async_read: return "fd_async_read";
+    case OperationCode::async_map_file: return "async_map_file";
+    case OperationCode::async_copy_file: return "async_copy_file";
+    case OperationCode::async_copy_directory: return "async_copy_directory";
+    case OperationCode::async_writev: return "async_writev";
+    case OperationCode::async_readv: return "async_readv";
+    case OperationCode::async_pread: return "async_pread";
+    case OperationCode::async_pwrite: return "async_pwrite";
+    case OperationCode::async_write_atomic: return "async_write_atomic";
+    }
+    return "unknown";
+}
+
+void FilesystemManager::sync_pending(Worker& w, bool force)
+{
+    if(w.syncs.empty() || (!force && std::chrono::steady_clock::now() < w.sync_due))
+        return;
+    std::vector<PendingSync> syncs;
+    syncs.swap(w.syncs);
+
+    // a single sync per file and per directory, however many operations are waiting for it
+    std::map<Path, ErrorCode> files, directories;
+    for(const auto& s : syncs) {
+        if(!files.count(s.path)) {
+            auto cached = cached_file(w, s.path, false);
+            File opened;
+            if(!cached)
+                opened = File(s.path, O_RDONLY);
+            auto& f = cached ? *cached : opened;
+            if(f && f.sync_data())
+                files.emplace(s.path, ErrorCode{ErrorCode::success});
+            else
+                files.emplace(s.path, ErrorCode(ErrorCode::write_failure, "the sync of the file " + s.path + " failed: " + last_error()));
+        }
+        if(s.durability != Durability::full)
+            continue;
+        auto dir = boost::filesystem::path(s.path).parent_path().native();
+        if(dir.empty())
+            dir = ".";
+        if(!directories.count(dir)) {
+            File d(dir, O_RDONLY | O_DIRECTORY);
+            if(d && d.sync())
+                directories.emplace(dir, ErrorCode{ErrorCode::success});
+            else
+                directories.emplace(dir, ErrorCode(ErrorCode::write_failure, "the sync of the directory " + dir + " failed: " + last_error()));
+        }
+    }
+
+    for(auto& s : syncs) {
+        auto ec = files[s.path];
+        if(ec == ErrorCode::success && s.durability == Durability::full) {
+            auto dir = boost::filesystem::path(s.path).parent_path().native();
+            ec = directories[dir.empty() ? "." : dir];
+        }
+        deliver(w, s.code, s.path, s.probe, false, std::move(s.handler), ec, ec == ErrorCode::success ? s.size : size_t{0});
+        if(stats_)
+            bytes_in_flight_ -= s.admitted_bytes;
+        if(s.admitted) {
+            ++w.released_operations;
+            w.released_bytes += s.admitted_bytes;
+        }
+    }
+}
 
 std::shared_ptr<ChunkedFstreamInterface> FilesystemManager::make_chunked_stream(const Path& p, size_t chunk_size)
 {
@@ -544,28 +1730,35 @@ std::shared_ptr<ChunkedFstreamInterface> FilesystemManager::make_chunked_stream(
 ChunkedReader::ChunkedReader(FilesystemManager& fs, const Path& p, size_t chunk_size)
     : fs_manager(fs)
     , path(p)
-    , is(p)
-    , file_size((is.seekg(0, std::ios::end), is.tellg()))
+    , file_(p, O_RDONLY)
+    , file_size(file_.size())
     , pos_to_schedule(0)
     , bytes_read_(0)
     , n_enqueued(0)
     , buf_(chunk_size)
     , stopped(false)
+    , trace_id(0)
+    , trace_parent(TraceScope::current())
 {
-    if(!is)
+    if(!file_ || file_size < 0)
         throw ErrorCode(ErrorCode::open_failure, "ChunkedReader was not able to open the file");
+    if(trace_observer()) {
+        trace_id = next_trace_id();
+        trace(trace_id, trace_parent, "chunked_stream", TracePhase::enqueue, path);
+    }
+}
 
-    // set uint8_t locale (to be able to read using uint8_t type)
-    is.imbue(utilities::utilities_locale);
-    // seek to the beginning (we've seeked to the end to check file size)
-    is.seekg(0, std::ios::beg);
-    // get the version
+ChunkedReader::~ChunkedReader()
+{
+    if(trace_id)
+        trace(trace_id, trace_parent, "chunked_stream", TracePhase::complete, path);
 }
 
 
 
 void ChunkedReader::next_chunk(ReadChunkHandler h)
 {
+    TraceScope scope{trace_id ? trace_id : TraceScope::current()};
     if(stopped) {
         fs_manager.get_io_service().post(std::bind(std::move(h), ErrorCode::stopped, Buffer{}));
         return;
@@ -574,7 +1767,7 @@ void ChunkedReader::next_chunk(ReadChunkHandler h)
     if(!q_buf_ready.empty()) {
         assert(q_buf_ready.front().is_hot());
         Buffer buf_copy{static_cast<const Buffer &>(q_buf_ready.front())};
-        q_buf_ready.front().set_hot(false);
+        consumed(q_buf_ready.front());
         fs_manager.get_io_service().post(std::bind(std::move(h), q_buf_ready.front().error_code(), std::move(buf_copy)));
         q_buf_ready.pop();
     }
@@ -593,7 +1786,7 @@ void ChunkedReader::next_chunk(ReadChunkHandler h)
             {
                 assert(buf_curr.is_hot());
                 Buffer buf_copy{static_cast<Buffer>(buf_curr)};
-                buf_curr.set_hot(false);
+                shared->consumed(buf_curr);
                 h(ec, std::move(buf_copy));
             });
             pos_to_schedule += buf_curr.size();
@@ -615,7 +1808,7 @@ void ChunkedReader::next_chunk(ReadChunkHandler h)
                 shared->q_handlers.pop();
                 assert(buf_curr.is_hot());
                 Buffer buf_copy{static_cast<Buffer>(buf_curr)};
-                buf_curr.set_hot(false);
+                shared->consumed(buf_curr);
                 enqueued_h(ec, std::move(buf_copy));
                 --shared->n_enqueued;
             }
@@ -630,98 +1823,26 @@ void ChunkedReader::next_chunk(ReadChunkHandler h)
 
 Buffer ChunkedReader::read_file_chunk(HotDoubleBuffer::BufferView &buf, size_t chunk_size, size_t pos)
 {
-    if (!is)
-        // NOTE: error code rather arbitrary... can we find a better code?
-        throw(ErrorCode(ErrorCode::read_failure, std::string{__func__} + ": the stream supplied was in fail state\n"));
-
     buf.resize(chunk_size);
-    is.seekg(pos);
-    is.read(buf.data(), buf.size());
-    // resize the return buffer to the number of bytes effectively read
-    buf.resize(is.gcount());
-    bytes_read_ += buf.size();
+    auto n = file_.read_at(buf.data(), buf.size(), pos);
+    if (n < 0)
+        throw(ErrorCode(ErrorCode::read_failure, std::string{__func__} + " was not able to read from " + path + ": " + last_error()));
+    chunk_read(buf, n);
 
     return buf;
 }
 
-void FilesystemManager::OperationsQueue::push_read(const Path &path, Buffer &buf, FilesystemManager::CompletionHandler h)
-{
-    std::lock_guard<std::mutex> lck{mtx};
-    q_operations.emplace(OperationCode::async_read, std::move(h));
-    q_read_data.emplace(path, buf);
-}
-
-void FilesystemManager::OperationsQueue::push_fd_read(std::unique_ptr<std::basic_ifstream<uint8_t>> in, Buffer&buf, FilesystemManager::CompletionHandler h)
-{
-    std::lock_guard<std::mutex> lck{mtx};
-    q_operations.emplace(OperationCode::fd_async_read, std::move(h));
-    q_fd_read_data.emplace(std::move(in), buf);
-}
-
-void FilesystemManager::OperationsQueue::push_write(const Path &path, const Buffer &buf, FilesystemManager::CompletionHandler h)
-{
-    std::lock_guard<std::mutex> lck{mtx};
-    q_operations.emplace(OperationCode::async_write, std::move(h));
-    q_write_data.emplace(path, buf);
-}
-
-void FilesystemManager::OperationsQueue::push_append(const Path &path, const Buffer &buf, FilesystemManager::CompletionHandler h) {
-    std::lock_guard<std::mutex> lck{mtx};
-    q_operations.emplace(OperationCode::async_append, std::move(h));
-    q_write_data.emplace(path, buf);
-}
-
-void FilesystemManager::OperationsQueue::push_chunked_read(std::shared_ptr<ChunkedReader> r, size_t pos, HotDoubleBuffer::BufferView &buf, FilesystemManager::CompletionHandler h)
-{
-    std::lock_guard<std::mutex> lck{mtx};
-    q_operations.emplace(OperationCode::async_read_chunk, std::move(h));
-    q_as_read_data.emplace(r, pos, buf);
-}
-
-std::tuple<FilesystemManager::OperationCode,const Path,std::reference_wrapper<Buffer>,FilesystemManager::CompletionHandler> FilesystemManager::OperationsQueue::pop_read()
-{
-    using std::get;
-    std::lock_guard<std::mutex> lck{mtx};
-    auto op = std::move(q_operations.front());
-    q_operations.pop();
-    std::tuple<const Path,std::reference_wrapper<Buffer>> path_buf = std::move(q_read_data.front());
-    q_read_data.pop();
-    return std::make_tuple(op.first, std::move(get<0>(path_buf)), get<1>(path_buf), std::move(op.second));
-}
-
-std::tuple<FilesystemManager::OperationCode, std::unique_ptr<std::basic_ifstream<uint8_t>>, std::reference_wrapper<Buffer>,FilesystemManager::CompletionHandler> FilesystemManager::OperationsQueue::pop_fd_read()
+void ChunkedReader::chunk_read(HotDoubleBuffer::BufferView& buf, size_t n)
 {
-    using std::get;
-    std::lock_guard<std::mutex> lck{mtx};
-    auto op = std::move(q_operations.front());
-    q_operations.pop();
-    std::tuple<std::unique_ptr<std::basic_ifstream<uint8_t>>, std::reference_wrapper<Buffer>> path_buf = std::move(q_fd_read_data.front());
-    q_fd_read_data.pop();
-    return std::make_tuple(op.first, std::move(get<0>(path_buf)), std::move(get<1>(path_buf)), std::move(op.second));
-}
-
-std::tuple<FilesystemManager::OperationCode,const Path, std::reference_wrapper<const Buffer>,FilesystemManager::CompletionHandler> FilesystemManager::OperationsQueue::pop_write()
-{
-    using std::get;
-    std::lock_guard<std::mutex> lck{mtx};
-    auto op = std::move(q_operations.front());
-    q_operations.pop();
-    std::tuple<const Path,std::reference_wrapper<const Buffer>> path_buf = std::move(q_write_data.front());
-    q_write_data.pop();
-    return std::make_tuple(op.first, std::move(get<0>(path_buf)), get<1>(path_buf), std::move(op.second));
+    // resize the return buffer to the number of bytes effectively read
+    buf.resize(n);
+    bytes_read_ += buf.size();
 }
 
-
-
-std::tuple<FilesystemManager::OperationCode,std::shared_ptr<ChunkedReader>,size_t,HotDoubleBuffer::BufferView,FilesystemManager::CompletionHandler> FilesystemManager::OperationsQueue::pop_chunked_read()
+void ChunkedReader::consumed(HotDoubleBuffer::BufferView& buf)
 {
-    using std::get;
-    std::lock_guard<std::mutex> lck{mtx};
-    auto op = std::move(q_operations.front());
-    q_operations.pop();
-    std::tuple<std::shared_ptr<impl::ChunkedReader>,size_t,impl::HotDoubleBuffer::BufferView> reader = std::move(q_as_read_data.front());
-    q_as_read_data.pop();
-    return std::make_tuple(op.first, get<0>(reader), get<1>(reader), std::ref(get<2>(reader)), std::move(op.second));
+    buf.set_hot(false);
+    fs_manager.resume_chunk_reads(*this);
 }
 
 // --------------------------------------------- chunked fstream
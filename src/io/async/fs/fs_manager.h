@@ -2,6 +2,12 @@
 #define CYNNYPP_FS_MANAGER_H_H
 
 #include "fs_manager_interface.h"
+#include "posix_file.h"
+#include "mapped_region.h"
+#include "latency_histogram.h"
+#include "trace.h"
+#include "utilities/mpsc_queue.h"
+#include "utilities/wakeup.h"
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -13,6 +19,13 @@
 #include <type_traits>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <deque>
+#include <array>
+#include <chrono>
 
 
 namespace cynny {
@@ -34,6 +47,9 @@ class FilesystemManager;
  */
 namespace impl {
 
+class FileCache;
+class MetadataCache;
+
 using ReadChunkHandler = FilesystemManagerInterface::ReadChunkHandler;
 
 /**
@@ -138,6 +154,7 @@ public:
     ChunkedReader(ChunkedReader&&) = default;
     ChunkedReader& operator=(const ChunkedReader&) = delete;
     ChunkedReader& operator=(ChunkedReader&&) = default;
+    ~ChunkedReader();
 
     /**
      * @brief next_chunk asynchronously reads another chunk and passes it (by copy) to h when done
@@ -153,8 +170,23 @@ public:
      * @return a Buffer containing bytes read
      */
     Buffer read_file_chunk(HotDoubleBuffer::BufferView& buf, size_t chunk_size, size_t pos);
+
+    /**
+     * @brief chunk_read accounts for a chunk of n bytes read into buf by someone else
+     * (i.e. by a transfer of the io_uring backend on file()), as read_file_chunk does for its own reads.
+     */
+    void chunk_read(HotDoubleBuffer::BufferView& buf, size_t n);
     void stop() { stopped = true; }
 
+    /**
+     * @brief ready tells whether the read of the chunk at pos into buf can start: the previous chunk
+     * has been read and buf has been consumed, or the reader has been stopped.
+     */
+    bool ready(size_t pos, const HotDoubleBuffer::BufferView& buf) const { return stopped || (bytes_read_ == pos && !buf.is_hot()); }
+
+    const Path& file_path() const { return path; }
+    const File& file() const { return file_; }
+
     size_t bytes_read() const { return bytes_read_; }
     bool is_stopped() const { return stopped; }
     bool eof() const { assert(bytes_read_ <= file_size); return bytes_read_ == file_size; }
@@ -162,10 +194,15 @@ public:
     static const size_t default_chunk_size;
 
 private:
+    /**
+     * @brief consumed marks buf as consumed, so that the read of a following chunk waiting for it can start.
+     */
+    void consumed(HotDoubleBuffer::BufferView& buf);
+
     FilesystemManager& fs_manager;
 
     const Path path;
-    std::basic_ifstream<uint8_t> is;
+    File file_;
     const pos_type file_size;
 
     pos_type pos_to_schedule; // used only by "main" thread
@@ -177,6 +214,10 @@ private:
     std::queue<HotDoubleBuffer::BufferView> q_buf_ready;
 
     bool stopped;
+
+    // the reads of the chunks are traced as children of the stream (0 if not traced)
+    uint64_t trace_id;
+    uint64_t trace_parent;
 };
 
 }
@@ -185,12 +226,124 @@ private:
 
 // -----------------------------------   FilesystemManager for asynchrounous I/O
 
+/**
+ * @brief The CancellationToken class lets the submitter of asynchronous operations give up on them:
+ * copies of a token share its state, so that the token kept by the submitter cancels all the operations
+ * it was handed to. Operations are only cancelled before they start: once a worker has begun one, it is carried out.
+ *
+ * All the functions can be invoked by any thread.
+ */
+class CancellationToken {
+    friend class FilesystemManager;
+public:
+    CancellationToken() : state{std::make_shared<std::atomic_bool>(false)} {}
+
+    void cancel() { state->store(true, std::memory_order_relaxed); }
+
+    bool cancelled() const { return state->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic_bool> state;
+};
+
 /**
  * @brief The FilesystemManager class implements an asynchronous interface to the filesystem
+ *
+ * Asynchronous operations are executed by a pool of worker threads. Every operation is
+ * assigned to a worker by hashing the path it refers to, so that operations on the same
+ * path are executed in submission order, while operations on different paths may run in parallel.
+ *
+ * Every operation is submitted with a Priority: each worker performs the waiting operation of the
+ * highest class, but an operation is overtaken by at most Options::priority_aging operations of higher
+ * classes, so that bulk work cannot starve. An operation never overtakes one on the same path submitted
+ * before it, whatever their classes: the operations on a path are still performed in submission order,
+ * and only those on different paths are reordered.
+ *
+ * Each worker posts the completion handlers of the operations it finishes to the io_service in groups, as a single
+ * handler that runs them in order: a group is posted as soon as the worker has nothing else to do, holds 64 handlers,
+ * its first handler has waited 100 microseconds or the next operation may take long (anything but a transfer
+ * of a known size up to 64 KiB).
+ *
+ * Reads, writes and appends can also be submitted with a CancellationToken and a deadline: an operation whose token
+ * has been cancelled, or whose deadline has passed, by the time a worker gets to it is not performed, and its
+ * handler receives ErrorCode::stopped.
+ *
+ * With Options::max_queued_bytes or Options::max_queued_operations, the reads, writes and appends (including those
+ * of a batch) that would exceed the limits are refused: they are not queued, and their handler receives
+ * ErrorCode::would_block. The submitter can wait with async_wait_capacity before submitting them again.
+ * When nothing is queued an operation is always accepted, however large.
+ *
+ * With Options::fd_cache_size > 0, the workers of the threads backend keep the descriptors of the regular files
+ * they read, write and append to open, and reuse them for the following operations on the same path (direct I/O
+ * and the io_uring backend do not use them). The descriptors are dropped by removeFile, move and removeDirectory
+ * of this object, but not when the files are removed, renamed or replaced by anyone else: a cached path keeps
+ * referring to the file that was open, so the cache must be enabled only when the files are managed through
+ * this FilesystemManager.
+ *
+ * Likewise, with Options::metadata_ttl > 0 the type and the size of the paths checked before each operation are
+ * remembered for that long. The synchronous and asynchronous operations of this object update them as they go,
+ * but changes made by anyone else (including the standalone functions) are noticed only when they expire: until
+ * then, operations may be admitted or rejected according to the former type of the path.
  */
 class FilesystemManager : public FilesystemManagerInterface {
 public:
-    FilesystemManager(boost::asio::io_service& io);
+    /**
+     * @brief The Backend enum lists the engines that can be used by the workers to perform the asynchronous operations.
+     *
+     * - threads: every operation is performed with blocking calls on the worker thread;
+     * - io_uring: reads, writes and appends are submitted to a Linux io_uring owned by the worker,
+     *   so that each worker keeps many of them in flight; the other operations are performed as with threads.
+     */
+    enum class Backend {
+        threads, io_uring
+    };
+
+    /**
+     * @brief The Options struct collects the settings of a FilesystemManager.
+     */
+    struct Options {
+        // number of worker threads performing the asynchronous operations (at least 1)
+        size_t workers = 1;
+        // engine used by the workers
+        Backend backend = Backend::threads;
+        // maximum number of operations of higher priority classes that can overtake a waiting operation (at least 1)
+        size_t priority_aging = 16;
+        // number of descriptors of regular files kept open by each worker between the operations on them,
+        // to save an open and a close per operation on hot files (0 disables the cache; see FilesystemManager for its limits)
+        size_t fd_cache_size = 0;
+        // how long the type and the size of the paths checked before the operations are remembered,
+        // to save a stat per operation (0 disables the cache; see FilesystemManager for its limits)
+        std::chrono::milliseconds metadata_ttl{0};
+        // maximum number of bytes written or appended by the reads, writes and appends queued at the same time,
+        // and maximum number of them (0 means no limit; see async_wait_capacity)
+        size_t max_queued_bytes = 0;
+        size_t max_queued_operations = 0;
+        // longest time the handler of a durable write or append waits for others to share its sync;
+        // the pending syncs are performed earlier as soon as the worker has nothing else to do,
+        // or before an operation that may take long
+        std::chrono::microseconds sync_window{1000};
+        // record how long the operations wait, run and take to be delivered, and how many are queued (see metrics)
+        bool metrics = false;
+    };
+
+    /**
+     * @brief Create a FilesystemManager.
+     * @param io the io_service on which completion handlers are posted
+     * @param n_workers the number of worker threads performing the asynchronous operations (at least 1)
+     * @param backend the engine used by the workers
+     *
+     * \throws std::invalid_argument if n_workers is 0
+     * \throws ErrorCode::internal_failure if the backend is not supported by the system
+     */
+    FilesystemManager(boost::asio::io_service& io, size_t n_workers = 1, Backend backend = Backend::threads);
+
+    /**
+     * @brief Create a FilesystemManager with the given options.
+     *
+     * \throws std::invalid_argument if options.workers or options.priority_aging is 0
+     * \throws ErrorCode::internal_failure if the backend is not supported by the system
+     */
+    FilesystemManager(boost::asio::io_service& io, const Options& options);
     FilesystemManager(const FilesystemManager&) = delete;
     FilesystemManager(FilesystemManager&&) = default;
 
@@ -201,6 +354,53 @@ public:
 
     boost::asio::io_service& get_io_service() { return io_; }
 
+    size_t workers_count() const { return workers_.size(); }
+
+    Backend backend() const { return backend_; }
+
+    /**
+     * @brief queued_operations returns the number of the reads, writes and appends accepted and not yet completed,
+     * as limited by Options::max_queued_operations; it is 0 if no limit is set.
+     */
+    size_t queued_operations();
+
+    /**
+     * @brief queued_bytes returns the number of bytes of the writes and appends accepted and not yet completed,
+     * as limited by Options::max_queued_bytes; it is 0 if no limit is set.
+     */
+    size_t queued_bytes();
+
+    /**
+     * @brief The OperationMetrics struct collects the latencies of the operations of a kind.
+     */
+    struct OperationMetrics {
+        // from the submission to the moment a worker starts the operation
+        impl::LatencyHistogram::Snapshot queue_wait;
+        // from that moment to the end of the operation, including the syncs of the durable writes and appends
+        impl::LatencyHistogram::Snapshot execution;
+        // from the end of the operation to the invocation of its completion handler on the io_service
+        impl::LatencyHistogram::Snapshot dispatch;
+    };
+
+    /**
+     * @brief The Metrics struct is a snapshot of what has been recorded with Options::metrics.
+     */
+    struct Metrics {
+        // by name of the operation (e.g. "async_read"), for the operations started at least once;
+        // the internal operations (the chunks of a ChunkedFstream, the files of a directory copy) are listed too
+        std::map<std::string, OperationMetrics> operations;
+        // operations submitted and not started yet by a worker
+        size_t queue_depth = 0;
+        // bytes to be written by the operations submitted and not completed yet
+        size_t bytes_in_flight = 0;
+    };
+
+    /**
+     * @brief metrics returns a snapshot of the latencies recorded so far and of the current queue depth;
+     * it is empty without Options::metrics. It can be invoked by any thread, and it does not stop the workers.
+     */
+    Metrics metrics() const;
+
 
     //-------------------------------------------    operational functions
 
@@ -329,6 +529,21 @@ public:
     void appendToFile(const Path& p, const Buffer& bytes) override;
 
 
+    /**
+     * Map a whole file in memory, read-only.
+     *
+     * All the holders of the returned region share the same pages of the page cache,
+     * so serving the file does not require copying its content.
+     *
+     * \param p - path to the file to be mapped
+     *
+     * \returns the region, which stays mapped as long as somebody holds it
+     *
+     * \throws If some filesystem error occurs, or if p is a symlink or not a  a regular file, a FilesystemError is thrown
+     */
+    std::shared_ptr<const MappedRegion> mapFile(const Path& p);
+
+
 
     //--------------------------------------------- asynchronous interface
 
@@ -344,7 +559,7 @@ public:
      * contention on the file system.
      *
      * \param p - the path to the file to be read
-     * \param buf - the buffer where the caller want the read data to be deposited
+     * \param buf - the buffer where the caller want the read data to be deposited; its storage is reused
      * \param h - completion handler for the read operation (must be convertible to FilesystemManager::CompletionHandler)
      */
     void async_read(const Path& p, Buffer& buf, CompletionHandler h) override;
@@ -380,18 +595,264 @@ public:
     void async_append(const Path &p, const Buffer &buf, FilesystemManagerInterface::CompletionHandler h) override;
 
 
+    /*
+     * The same operations, submitted with a priority class other than Priority::normal.
+     */
+
+    void async_read(const Path& p, Buffer& buf, CompletionHandler h, Priority prio) override;
+
+    void async_write(const Path& p, const Buffer& buf, CompletionHandler h, Priority prio) override;
+
+    void async_append(const Path& p, const Buffer& buf, CompletionHandler h, Priority prio) override;
+
+
+    /*
+     * The same operations, submitted with the given options (see SubmitOptions).
+     */
+
+    void async_read(const Path& p, Buffer& buf, CompletionHandler h, const SubmitOptions& opts) override;
+
+    void async_write(const Path& p, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts) override;
+
+    void async_append(const Path& p, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts) override;
+
+
+    /**
+     * @brief BufferHandler is the completion handler of the operations that take the ownership of a buffer:
+     * the buffer is handed back to it, so that it can be recycled for the next operation.
+     */
+    using BufferHandler = std::function<void(const ErrorCode& ec, Buffer buf)>;
+
+    /**
+     * Register an asynch read request that takes the ownership of the destination buffer.
+     *
+     * The file content is read into the storage of buf, which is handed back to h along with the outcome
+     * of the operation: a buffer recycled from a previous read is filled without allocations and without
+     * zero-filling it first.
+     *
+     * \param p - the path to the file to be read
+     * \param buf - the buffer where the read data are deposited
+     * \param h - completion handler receiving the buffer
+     */
+    void async_read(const Path& p, Buffer&& buf, BufferHandler h, const SubmitOptions& opts = {});
+
+    /**
+     * Register an asynch write request that takes the ownership of the buffer to be written,
+     * so that the caller needs not keep it alive; the buffer is handed back to h when done.
+     *
+     * \param p - the path to the file to be written
+     * \param buf - the buffer containing the data to be written to fs
+     * \param h - completion handler receiving the buffer
+     */
+    void async_write(const Path& p, Buffer&& buf, BufferHandler h, const SubmitOptions& opts = {});
+
+    /**
+     * Register an asynch append request that takes the ownership of the buffer to be appended,
+     * so that the caller needs not keep it alive; the buffer is handed back to h when done.
+     *
+     * \param p - the path to the file on which the append is performed
+     * \param buf - the buffer to append to the file
+     * \param h - completion handler receiving the buffer
+     */
+    void async_append(const Path& p, Buffer&& buf, BufferHandler h, const SubmitOptions& opts = {});
+
+
+    /**
+     * Register an asynch write request that replaces the content of a file atomically: the content is written
+     * to an unnamed file (O_TMPFILE) in the same directory, which then takes the place of p, so that readers
+     * see either the former file or the whole new content, never a part of it. Where unnamed files are not supported,
+     * a temporary file is written beside p and renamed. The content is synced (fdatasync) before it takes the place of p,
+     * so that not even a crash can leave p empty or partially written; the rename itself is durable only once
+     * the directory is synced.
+     *
+     * \param p - the path to the file to be written, which is a new file (a new inode) afterwards
+     * \param buf - the buffer to be written; it must be kept alive until the handler is invoked
+     * \param h - completion handler, receiving the number of bytes written
+     */
+    void async_write_atomic(const Path& p, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts = {});
+
+
+    /**
+     * @brief ConstBuffers and MutableBuffers describe discontiguous memory regions, to be written or filled in order.
+     */
+    using ConstBuffers = std::vector<boost::asio::const_buffer>;
+    using MutableBuffers = std::vector<boost::asio::mutable_buffer>;
+
+    /**
+     * Register an asynch write request whose content is gathered from several buffers: they are written
+     * one after the other with a single system call, without concatenating them first.
+     * As with async_write, the content of the file is replaced (always through the page cache).
+     *
+     * \param p - the path to the file to be written
+     * \param bufs - the buffers to be written; the vector is copied, but the memory it refers to
+     * must be kept alive until the handler is invoked
+     * \param h - completion handler, receiving the number of bytes written
+     */
+    void async_writev(const Path& p, const ConstBuffers& bufs, CompletionHandler h, const SubmitOptions& opts = {});
+
+    /**
+     * Register an asynch read request that scatters the content of a file, starting from an offset,
+     * into several buffers, filling them in order with a single system call.
+     *
+     * \param p - the path to the file to be read
+     * \param offset - the position of the first byte to be read
+     * \param bufs - the buffers to be filled; the vector is copied, but the memory it refers to
+     * must be kept alive until the handler is invoked
+     * \param h - completion handler, receiving the number of bytes read: it is less than the total size
+     * of the buffers only if the file ends before
+     */
+    void async_readv(const Path& p, uint64_t offset, const MutableBuffers& bufs, CompletionHandler h, const SubmitOptions& opts = {});
+
+    /**
+     * Register an asynch read request of a range of a file, without reading the rest of it.
+     *
+     * \param p - the path to the file to be read
+     * \param offset - the position of the first byte to be read
+     * \param length - the maximum number of bytes to be read
+     * \param buf - the buffer to be filled; it is resized to the bytes actually read, which are less
+     * than length only if the file ends before (none if offset is past its end)
+     * \param h - completion handler, receiving the number of bytes read
+     */
+    void async_pread(const Path& p, uint64_t offset, size_t length, Buffer& buf, CompletionHandler h, const SubmitOptions& opts = {});
+
+    /**
+     * Register an asynch write request of a range of a file: the bytes outside the range are left untouched,
+     * the file is created if it does not exist and it is extended (with zeros) if offset is past its end.
+     *
+     * \param p - the path to the file to be written
+     * \param offset - the position where the content of buf is written
+     * \param buf - the buffer to be written; it must be kept alive until the handler is invoked
+     * \param h - completion handler, receiving the number of bytes written
+     */
+    void async_pwrite(const Path& p, uint64_t offset, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts = {});
+
+
+    /**
+     * Register an asynch request to copy a file (see copyFile): the copy is performed on the worker thread,
+     * inside the kernel when the filesystems allow it.
+     *
+     * \param from - path to the file to be copied
+     * \param to - path to copy the file to
+     * \param h - completion handler for the copy, receiving the number of bytes copied
+     */
+    void async_copy_file(const Path& from, const Path& to, CompletionHandler h, Priority prio = Priority::normal);
+
+    /**
+     * @brief The CopyProgress struct reports the progress of an async_copy_directory.
+     */
+    struct CopyProgress {
+        size_t files_copied;
+        size_t files_total;
+        uintmax_t bytes_copied;
+        uintmax_t bytes_total;
+    };
+
+    /**
+     * @brief ProgressHandler is invoked, on the thread running the io_service, every time a file has been copied.
+     */
+    using ProgressHandler = std::function<void(const CopyProgress& progress)>;
+
+    /**
+     * Register an asynch request to recursively copy a directory (see copyDirectory).
+     *
+     * The whole directory tree is created first; then the files are copied by all the workers in parallel,
+     * keeping at most max_in_flight copies queued at the same time. On the first failure no more copies are started
+     * and h is invoked, with the error, as soon as those in flight are over.
+     *
+     * \param from - path to the directory to be copied
+     * \param to - path to copy the directory to
+     * \param h - completion handler for the copy, receiving the number of bytes copied
+     * \param progress - optional handler notified after every file copied
+     * \param max_in_flight - maximum number of file copies queued at the same time; 0 means four per worker
+     * \param prio - the priority class of the copies
+     */
+    void async_copy_directory(const Path& from, const Path& to, CompletionHandler h, ProgressHandler progress = nullptr, size_t max_in_flight = 0, Priority prio = Priority::normal);
+
+
+    /**
+     * @brief The BatchOperation struct describes one of the operations submitted together by async_batch;
+     * it is built with BatchOperation::read, BatchOperation::write or BatchOperation::append.
+     * As with the single operations, the buffers must be kept alive until the batch is over.
+     */
+    struct BatchOperation {
+        enum class Kind {
+            read, write, append
+        };
+
+        static BatchOperation read(const Path& p, Buffer& buf) { return BatchOperation{Kind::read, p, &buf, nullptr}; }
+        static BatchOperation write(const Path& p, const Buffer& buf) { return BatchOperation{Kind::write, p, nullptr, &buf}; }
+        static BatchOperation append(const Path& p, const Buffer& buf) { return BatchOperation{Kind::append, p, nullptr, &buf}; }
+
+        Kind kind;
+        Path path;
+        // the buffer filled by a read
+        Buffer* dst;
+        // the buffer written or appended
+        const Buffer* src;
+    };
+
+    /**
+     * @brief The BatchResult struct is the outcome of one of the operations of a batch,
+     * i.e. what its completion handler would have received if it had been submitted alone.
+     */
+    struct BatchResult {
+        ErrorCode ec;
+        size_t size;
+    };
+
+    /**
+     * @brief BatchHandler is the completion handler of async_batch: it receives the error of the first operation
+     * that failed, in submission order, or success, and the results of all the operations, in submission order.
+     */
+    using BatchHandler = std::function<void(const ErrorCode& ec, const std::vector<BatchResult>& results)>;
+
+    /**
+     * Register a batch of reads, writes and appends at once: the operations of each worker are enqueued together
+     * and the worker is woken up once, and a single handler is invoked when all of them are over.
+     *
+     * The operations are performed as if they were submitted one by one, in the order they are given:
+     * those on the same path keep their order, the others may be performed in parallel.
+     *
+     * \param ops - the operations of the batch
+     * \param h - completion handler of the whole batch
+     * \param prio - the priority class of all the operations
+     */
+    void async_batch(const std::vector<BatchOperation>& ops, BatchHandler h, Priority prio = Priority::normal);
+
+
+    /**
+     * Register a request to be notified when the limits on the queued operations admit another one
+     * writing bytes bytes: h is posted, with success, at once if they already do. Handlers waiting for
+     * capacity are notified in the order they were registered.
+     *
+     * \param bytes - the size of the buffer of the operation to be submitted (0 for a read)
+     * \param h - completion handler
+     */
+    void async_wait_capacity(size_t bytes, CompletionHandler h);
+
+
+    /**
+     * @brief MapHandler is the completion handler of async_map_file; on failure, the region is null.
+     */
+    using MapHandler = std::function<void(const ErrorCode& ec, std::shared_ptr<const MappedRegion> region)>;
+
+    /**
+     * Register an asynch request to map a whole file in memory (see mapFile);
+     * opening and mapping the file is performed on the worker thread.
+     *
+     * \param p - the path to the file to be mapped
+     * \param h - completion handler receiving the region
+     */
+    void async_map_file(const Path& p, MapHandler h, Priority prio = Priority::normal);
+
+
     /** Reads a chunk asynchronously, using a chunked reader
      * \param r the chunkedreader to be used to perform the read
      * \param pos the position from which the read starts
      * \param buf the buffer to be used to save the data
      * \param h the completion handler to be called on read termination.
      */
-    virtual void async_read_chunk(std::shared_ptr<impl::ChunkedReader> r, size_t pos, impl::HotDoubleBuffer::BufferView& buf, CompletionHandler h)
-    {
-        // enque a read request to the waiting queue
-        q_.push_chunked_read(r, pos, buf, h);
-        available_.set_event();
-    }
+    virtual void async_read_chunk(std::shared_ptr<impl::ChunkedReader> r, size_t pos, impl::HotDoubleBuffer::BufferView& buf, CompletionHandler h);
 
     /**
      * @brief make_chunked_stream
@@ -408,75 +869,402 @@ public:
 
 private:
     enum class OperationCode {
-        async_read, async_write, async_read_chunk, async_append, fd_async_read
+        async_read, async_write, async_read_chunk, async_append, fd_async_read, async_map_file,
+        async_copy_file, async_copy_directory, async_writev, async_readv,
+        async_pread, async_pwrite, async_write_atomic
     };
+    // keep in sync with the last operation code and with operation_name
+    static constexpr size_t n_operation_codes = static_cast<size_t>(OperationCode::async_write_atomic) + 1;
+    static const char* operation_name(OperationCode code);
+
+    friend class impl::ChunkedReader;
+
+    struct Probe;
+    struct Operation;
+    struct Worker;
+    struct UringContext;
+    struct DirectoryCopy;
+    struct Batch;
 
     /**
-     * @brief perform_next_operation runs on the fs_manager thread.
-     * It pops from the front of the asynchronous operations queue,
+     * @brief perform_operation runs on a worker thread.
+     * It receives an operation popped from the front of the worker's asynchronous operations queue,
      * switches on the operation code, performs (synchronously) the
      * corresponding operation and schedules the completion handler
      * the be executed on the application's main thread.
+     * @param w the worker whose queue the operation was popped from
+     * @param op the operation to be performed
+     */
+    void perform_operation(Worker& w, std::unique_ptr<Operation> op);
+
+    /**
+     * @brief perform_appends runs on a worker thread and performs a sequence of appends to the same path,
+     * popped one after the other from the worker's queues, opening the file once and writing all the buffers
+     * with a single writev; each completion handler receives the outcome of its own append.
      */
-    void perform_next_operation();
+    void perform_appends(Worker& w, std::vector<std::unique_ptr<Operation>>& ops);
 
     /**
-     * @brief process_queue contains the loop to be executed by the
-     * FilesystemManager thread. This function waits on the available_ event
-     * of the FilesystemManager and invoke the execution of the next operation
-     * when the event is signaled.
+     * @brief park keeps aside, returning true, a chunk read that cannot start yet (see ChunkedReader::ready),
+     * so that the worker does not spin on it; it returns false, leaving op alone, otherwise.
+     */
+    static bool park(Worker& w, std::unique_ptr<Operation>& op);
+
+    /**
+     * @brief resume_parked enqueues again the parked chunk reads that can start; they keep their place
+     * in the submission order (see Worker::pop). Only the worker thread can invoke it.
+     */
+    static void resume_parked(Worker& w);
+
+    /**
+     * @brief resume_chunk_reads wakes up the worker of r, whose parked chunk reads may be able to start;
+     * it can be invoked by any thread.
+     */
+    void resume_chunk_reads(const impl::ChunkedReader& r) { wake(worker_for(r.file_path())); }
+
+    /**
+     * @brief complete delivers the outcome of an operation performed by w to its completion handler, which is posted
+     * to the io_service along with the others completed by w (see flush_completions), or invoked at once
+     * on the worker thread for the operations of a batch.
+     */
+    void complete(Worker& w, const Operation& op, CompletionHandler h, const ErrorCode& ec, size_t size);
+
+    /**
+     * @brief discard_stopped completes with ErrorCode::stopped an operation that has been cancelled
+     * or whose deadline has passed, returning true; it returns false, leaving op alone, otherwise.
+     */
+    bool discard_stopped(Worker& w, std::unique_ptr<Operation>& op);
+
+    struct PendingSync;
+
+    /**
+     * @brief sync_pending runs on a worker thread and makes durable the writes and appends waiting for a sync
+     * (see complete), then delivers their outcome; unless force is set, it does nothing before the sync window expires.
+     */
+    void sync_pending(Worker& w, bool force);
+
+    /**
+     * @brief mark_enqueued and mark_started record when an operation is queued and when a worker starts it,
+     * with Options::metrics, and report it to the trace observer; an operation is marked as started only once.
+     */
+    void mark_enqueued(Operation& op);
+    void mark_started(Operation& op);
+
+    /**
+     * @brief deliver collects a completion handler among the ones to be posted by w, or invokes it at once if batched,
+     * recording the execution and dispatch latencies of the operation with Options::metrics and reporting them
+     * to the trace observer.
+     */
+    void deliver(Worker& w, OperationCode code, const Path& path, const Probe& probe, bool batched, CompletionHandler h, const ErrorCode& ec, size_t size);
+
+    /**
+     * @brief flush_completions runs on a worker thread and posts to the io_service, as a single handler, the completion
+     * handlers collected by deliver, to be run in the order their operations finished; then it releases the room
+     * reserved by the operations. Unless force is set, it does nothing before max_batched_completions handlers
+     * are collected or the first of them has waited long enough.
+     */
+    void flush_completions(Worker& w, bool force);
+
+    /**
+     * @brief submit enqueues a read, write or append on the worker owning its path, subject to the limits
+     * on the queued operations: when they would be exceeded, the handler receives ErrorCode::would_block.
+     */
+    void submit(std::unique_ptr<Operation> op, Priority prio);
+
+    /**
+     * @brief submit applies the options of the submission to the operation, then enqueues it as above.
+     */
+    void submit(std::unique_ptr<Operation> op, const SubmitOptions& opts);
+
+    /**
+     * @brief admit reserves room for n operations of the given total size, if the limits allow it.
+     * It must be invoked only if limits are set.
+     */
+    bool admit(size_t n, size_t bytes);
+
+    /**
+     * @brief release frees the room reserved for n operations of the given total size and notifies the handlers waiting for it.
+     */
+    void release(size_t n, size_t bytes);
+
+    /**
+     * @brief fits tells whether n operations of the given total size would be admitted now;
+     * capacity_mutex_ must be held.
+     */
+    bool fits(size_t n, size_t bytes) const;
+
+    /**
+     * @brief queued_size returns the number of bytes accounted for a queued operation.
+     */
+    static size_t queued_size(const Operation& op);
+
+    /**
+     * @brief is_short tells whether an operation is known to transfer at most max_short_operation_size bytes,
+     * so that the worker can keep the syncs and the completion handlers waiting while it performs it; operations of unknown size
+     * (e.g. whole file reads and copies) are not short.
+     */
+    static bool is_short(const Operation& op);
+
+    /**
+     * @brief read_file, write_file and append_to_file access the whole file p with O_DIRECT, if direct is set,
+     * or as readFile, writeFile and appendToFile otherwise.
+     */
+    void read_file(const Path& p, Buffer& buf, bool direct);
+    void write_file(const Path& p, const Buffer& buf, bool direct);
+    void append_to_file(const Path& p, const Buffer& bytes, bool direct);
+
+    /**
+     * @brief cached_file returns the descriptor of p cached by the worker w, if the cache is enabled
+     * and p can be cached; an empty pointer otherwise. The descriptor for the appends (append = true)
+     * is opened with O_APPEND.
+     */
+    std::shared_ptr<impl::File> cached_file(Worker& w, const Path& p, bool create, bool append = false);
+
+    /**
+     * @brief forget drops whatever is cached about p and the paths below it, i.e. the descriptors
+     * kept by the workers and the metadata; it is invoked after the changes made to them.
+     */
+    void forget(const Path& p);
+
+    /**
+     * @brief record_write updates the cached metadata, if enabled, after the file p has been written
+     * successfully: size is its new size for async_write and the number of bytes appended for async_append.
+     */
+    void record_write(const Path& p, OperationCode code, uintmax_t size);
+
+    /**
+     * @brief file_size returns the size of the regular file p, from the cached metadata if enabled, or 0 if unknown.
+     */
+    uintmax_t file_size(const Path& p);
+
+    /**
+     * @brief enqueue pushes an operation on the queue of its priority class of a worker and wakes it up.
+     */
+    void enqueue(Worker& w, std::unique_ptr<Operation> op, Priority prio = Priority::normal);
+
+    /**
+     * @brief copy_next_files starts the copies of the files of an async_copy_directory, up to its
+     * limit of copies in flight, and completes it when all of them are over.
+     */
+    void copy_next_files(std::shared_ptr<DirectoryCopy> job);
+
+    /**
+     * @brief wake notifies a worker that new operations are available.
+     */
+    void wake(Worker& w);
+
+    /**
+     * @brief process_queue contains the loop to be executed by a
+     * FilesystemManager worker thread. This function waits on the wakeup
+     * of the worker and invoke the execution of the next operations
+     * when it is notified.
      * @param fs a reference to the FilesystemManager object who holds
      * the thread I'm running on
+     * @param w the worker the thread belongs to
+     */
+    static void process_queue(FilesystemManager& fs, Worker& w);
+
+    /**
+     * @brief worker_for returns the worker in charge of the operations on p.
+     * The same path is always mapped on the same worker, so that
+     * operations on it are performed in the order they were submitted.
      */
-    static void process_queue(FilesystemManager& fs);
+    Worker& worker_for(const Path& p) { return *workers_[worker_index(p)]; }
 
+    /**
+     * @brief worker_index returns the index of worker_for(p) among the workers.
+     */
+    size_t worker_index(const Path& p) const { return std::hash<Path>{}(p) % workers_.size(); }
 
     /**
-     * @brief The OperationsQueue class is a thread-safe queue of asynchronous operations
-     * that may be executed by a FilesystemManager. It stores the operation code,
-     * the complation handler and any other data needed for that particular kind of
-     * operation.
+     * @brief next_worker returns a worker in round robin order; it is used
+     * for those operations that are not bound to a path.
      */
-    class OperationsQueue {
-    public:
-        // Having a mutex, for simplicity I make my queue not copyable
-        OperationsQueue() = default;
-        OperationsQueue(const OperationsQueue&) = default;
-        OperationsQueue(OperationsQueue&&) = default;
-        OperationsQueue& operator=(const OperationsQueue&) = delete;
-        OperationsQueue& operator=(OperationsQueue&&) = default;
-
-        // wrap all queue actions inside a locked scope
-        bool empty() const { std::lock_guard<std::mutex> lck{mtx}; return q_operations.empty(); }
-        size_t size() const { std::lock_guard<std::mutex> lck{mtx}; return q_operations.size(); }
-
-        void push_read(const Path& path, Buffer& buf, CompletionHandler h);
-        void push_fd_read(std::unique_ptr<std::basic_ifstream<uint8_t>> in, Buffer&buf, CompletionHandler h);
-        void push_write(const Path& path, const Buffer& buf, CompletionHandler h);
-        void push_append(const Path& path, const Buffer& buf, CompletionHandler h);
-        void push_chunked_read(std::shared_ptr<impl::ChunkedReader> r, size_t pos, impl::HotDoubleBuffer::BufferView& buf, CompletionHandler h);
-
-        std::tuple<OperationCode,const Path,std::reference_wrapper<Buffer>,CompletionHandler> pop_read();
-        std::tuple<OperationCode, std::unique_ptr<std::basic_ifstream<uint8_t>>, std::reference_wrapper<Buffer>,CompletionHandler> pop_fd_read();
-        std::tuple<OperationCode,const Path,std::reference_wrapper<const Buffer>,CompletionHandler> pop_write();
-        std::tuple<OperationCode,std::shared_ptr<impl::ChunkedReader>,size_t,impl::HotDoubleBuffer::BufferView,CompletionHandler> pop_chunked_read();
-
-        OperationCode front() const { std::lock_guard<std::mutex> lck{mtx}; return q_operations.front().first; }
+    Worker& next_worker() { return *workers_[next_worker_++ % workers_.size()]; }
 
-    private:
-        std::queue<std::pair<OperationCode,CompletionHandler>> q_operations;
-        std::queue<std::tuple<const Path,std::reference_wrapper<const Buffer>>> q_write_data;
-        std::queue<std::tuple<const Path,std::reference_wrapper<Buffer>>> q_read_data;
-        std::queue<std::tuple<std::unique_ptr<std::basic_ifstream<uint8_t>>, std::reference_wrapper<Buffer>>> q_fd_read_data;
-        std::queue<std::tuple<std::shared_ptr<impl::ChunkedReader>,size_t,impl::HotDoubleBuffer::BufferView>> q_as_read_data;
-        mutable std::mutex mtx;
+
+    /**
+     * @brief The Probe struct is what the metrics and the trace observer follow of an operation.
+     */
+    struct Probe {
+        // with Options::metrics or when traced, when the operation has been queued and started
+        std::chrono::steady_clock::time_point enqueued;
+        std::chrono::steady_clock::time_point started;
+        // 0 if the operation is not traced
+        uint64_t trace_id = 0;
+        uint64_t trace_parent = 0;
+    };
+
+    /**
+     * @brief The Operation struct is the record of an asynchronous operation, as stored
+     * in the operations queue of a worker. It holds the operation code, the path the
+     * operation refers to and the completion handler; any other data needed for a particular
+     * kind of operation is stored in the derived records, selected through the operation code.
+     */
+    struct Operation : utilities::MpscNode {
+        Operation(OperationCode code, const Path& path, CompletionHandler h)
+            : code{code}, path{path}, handler{std::move(h)}, priority{Priority::normal}, batched{false}
+            , deadline{Deadline::max()}, admitted{false}, admitted_bytes{0}, durability{Durability::none}, direct_io{false}, sequence{0}
+        {}
+
+        OperationCode code;
+        Path path;
+        CompletionHandler handler;
+        Priority priority;
+        // the handler belongs to a batch: it is invoked on the worker thread (see complete)
+        bool batched;
+        // set by the CancellationToken of the operation, if any
+        std::shared_ptr<const std::atomic_bool> cancelled;
+        // the operation is not started after this time point
+        Deadline deadline;
+        // room reserved for the operation under the limits on the queued operations, released on completion;
+        // the bytes are also counted with Options::metrics
+        bool admitted;
+        size_t admitted_bytes;
+        // what has to be synced before the handler of a write or append is invoked
+        Durability durability;
+        // a whole file read, write or append performed with O_DIRECT
+        bool direct_io;
+        // the submission order among the operations of the worker, assigned by Worker::push
+        uint64_t sequence;
+        Probe probe;
+    };
+
+    /**
+     * @brief The OperationStats struct holds the latencies recorded for a kind of operations.
+     */
+    struct OperationStats {
+        impl::LatencyHistogram queue_wait;
+        impl::LatencyHistogram execution;
+        impl::LatencyHistogram dispatch;
+    };
+
+    /**
+     * @brief The PendingSync struct keeps what is needed to complete a write or append waiting for its sync.
+     */
+    struct PendingSync {
+        Path path;
+        Durability durability;
+        CompletionHandler handler;
+        size_t size;
+        bool admitted;
+        size_t admitted_bytes;
+        OperationCode code;
+        Probe probe;
+    };
+
+    // records of the specific operations, defined along with the implementation
+    struct ReadOperation;
+    struct WriteOperation;
+    struct StreamReadOperation;
+    struct ChunkReadOperation;
+    struct MapOperation;
+    struct CopyOperation;
+    struct DirectoryScanOperation;
+    struct GatherWriteOperation;
+    struct ScatterReadOperation;
+    struct PositionalReadOperation;
+    struct PositionalWriteOperation;
+
+    /**
+     * @brief OperationsQueue is the lock-free queue of the operations assigned to a worker:
+     * any thread can enqueue operations, while only the worker thread dequeues them.
+     */
+    using OperationsQueue = utilities::MpscQueue<Operation>;
+
+    static constexpr size_t n_priorities = 3;
+
+    // maximum number of appends performed with a single write by perform_appends
+    static constexpr size_t max_coalesced_appends = 64;
+
+    // maximum number of bytes transferred by a short operation (see is_short)
+    static constexpr size_t max_short_operation_size = 64 * 1024;
+
+    // maximum number of completion handlers posted together by flush_completions
+    static constexpr size_t max_batched_completions = 64;
+
+    /**
+     * @brief The Worker struct groups together the queues of the operations
+     * assigned to a worker thread (one for each priority class), the Wakeup notified when they are filled
+     * and the thread itself. Workers of the io_uring backend also own the state of their ring.
+     */
+    struct Worker {
+        /**
+         * @brief push enqueues an operation on the queue of its priority class; it can be invoked by any thread.
+         */
+        void push(std::unique_ptr<Operation> op)
+        {
+            number(*op);
+            q[static_cast<size_t>(op->priority)].push(std::move(op));
+        }
+
+        /**
+         * @brief push enqueues, all together, operations of the same priority class; it can be invoked by any thread.
+         */
+        void push(std::vector<std::unique_ptr<Operation>> ops, Priority prio)
+        {
+            for(auto& op : ops)
+                number(*op);
+            q[static_cast<size_t>(prio)].push(std::move(ops));
+        }
+
+        /**
+         * @brief pop returns the next operation to be performed, according to the priority classes,
+         * but never before an operation on the same path submitted earlier; only the worker thread can invoke it.
+         * @param aging the maximum number of times a waiting operation can be overtaken
+         * @return the operation, or an empty pointer if none is waiting
+         */
+        std::unique_ptr<Operation> pop(size_t aging);
+
+        // an operation enqueued again keeps its place in the submission order
+        void number(Operation& op) { if(!op.sequence) op.sequence = ++submitted; }
+
+        std::array<OperationsQueue, n_priorities> q;
+        std::atomic<uint64_t> submitted{0};
+        // the operations already taken from each queue by the worker thread, and the sequence numbers
+        // and classes of those waiting on each path
+        std::array<std::deque<std::unique_ptr<Operation>>, n_priorities> waiting;
+        std::unordered_map<Path, std::map<uint64_t, size_t>> waiting_on;
+        // how many times the operation at the front of each class has been overtaken
+        std::array<size_t, n_priorities> overtaken{};
+        // the chunk reads waiting for their reader (see park); only the worker thread accesses them
+        std::vector<std::unique_ptr<Operation>> parked;
+        Wakeup wakeup;
+        std::unique_ptr<UringContext> uring;
+        // descriptors kept open between the operations, if enabled
+        std::unique_ptr<impl::FileCache> files;
+        // the writes and appends waiting for a sync, and when the window of the first one expires;
+        // only the worker thread accesses them
+        std::vector<PendingSync> syncs;
+        std::chrono::steady_clock::time_point sync_due;
+        // the completion handlers waiting to be posted by flush_completions, when the first of them was collected,
+        // and the room reserved by their operations; only the worker thread accesses them
+        std::vector<std::function<void()>> completed;
+        std::chrono::steady_clock::time_point completed_since;
+        size_t released_operations = 0;
+        size_t released_bytes = 0;
+        std::thread thrd;
     };
 
     boost::asio::io_service& io_;
-    OperationsQueue q_;
-    Event available_;
+    const Backend backend_;
+    const size_t priority_aging_;
+    const std::chrono::microseconds sync_window_;
+    // latencies and gauges, with Options::metrics
+    std::unique_ptr<std::array<OperationStats, n_operation_codes>> stats_;
+    std::atomic<size_t> queue_depth_;
+    std::atomic<size_t> bytes_in_flight_;
+    std::unique_ptr<impl::MetadataCache> metadata_;
+    // limits on the queued operations (0 means no limit), and what is queued, guarded by capacity_mutex_
+    const size_t max_queued_bytes_;
+    const size_t max_queued_operations_;
+    std::mutex capacity_mutex_;
+    size_t queued_bytes_;
+    size_t queued_operations_;
+    std::deque<std::pair<size_t, CompletionHandler>> capacity_waiters_;
     std::atomic_bool done_;
-    std::thread thrd_;
+    std::atomic<size_t> next_worker_;
+    std::vector<std::unique_ptr<Worker>> workers_;
 };
 
 
@@ -619,6 +1407,19 @@ bool createDirectory(const Path& p, bool parents = false);
  */
 Buffer readFile(const Path& p);
 
+/**
+ * Read a whole file from the filesystem into an existing buffer.
+ *
+ * The storage of buf is reused: no allocation takes place if its capacity is enough,
+ * and only the bytes beyond its current size are initialised before being overwritten.
+ *
+ * \param p - path to the file to be read
+ * \param buf - the buffer receiving the file content
+ *
+ * \throws If some filesystem error occurs, or if p is a symlink or not a  a regular file, a FilesystemError is thrown
+ */
+void readFile(const Path& p, Buffer& buf);
+
 /**
  * Write a buffer to file
  *
@@ -639,6 +1440,17 @@ void writeFile(const Path& p, const Buffer& buf);
  */
 void appendToFile(const Path& p, const Buffer& bytes);
 
+/**
+ * Map a whole file in memory, read-only.
+ *
+ * \param p - path to the file to be mapped
+ *
+ * \returns the region, which stays mapped as long as somebody holds it
+ *
+ * \throws If some filesystem error occurs, or if p is a symlink or not a  a regular file, a FilesystemError is thrown
+ */
+std::shared_ptr<const MappedRegion> mapFile(const Path& p);
+
 
 }   // namespace filesystem
 
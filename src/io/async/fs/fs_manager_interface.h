@@ -1,6 +1,7 @@
 #ifndef FILESYSTEMMANAGERINTERFACE_H_H
 #define FILESYSTEMMANAGERINTERFACE_H_H
 
+#include <chrono>
 #include <cstdint>
 #include <string>
 #include <functional>
@@ -46,7 +47,8 @@ public:
         append_failure = 7,
         end_of_file = 8,
         unknown_error = 9,
-        stopped = 10
+        stopped = 10,
+        would_block = 11 // the FilesystemManager has too many operations queued: retry later
     };
 
     ErrorCode(Error ec = success, const std::string &err_msg = {})
@@ -73,6 +75,58 @@ private:
     static constexpr const auto tag = "FilesystemError: ";
 };
 
+/**
+ * @brief The Priority enum lists the classes of service of the asynchronous operations:
+ * interactive operations (e.g. reads serving a request) are performed before normal ones,
+ * which are performed before bulk ones (e.g. swaps and background copies).
+ */
+enum class Priority {
+    interactive, normal, bulk
+};
+
+// fwd declaration
+class CancellationToken;
+
+/**
+ * @brief Deadline is the time point after which a queued operation is not worth starting anymore.
+ */
+using Deadline = std::chrono::steady_clock::time_point;
+
+/**
+ * @brief The Durability enum lists what has to reach stable storage before the handler of a write or append is invoked.
+ *
+ * - none: nothing, the data may still be in the page cache;
+ * - data: the content of the file (fdatasync), which is enough for a file that already existed;
+ * - full: also the entry of the file in its directory (fsync of the parent), needed for a file just created.
+ */
+enum class Durability {
+    none, data, full
+};
+
+/**
+ * @brief The SubmitOptions struct collects the settings of a single asynchronous operation. It is built implicitly
+ * from a Priority, so that the operations taking it can be given just a priority class.
+ */
+struct SubmitOptions {
+    SubmitOptions(Priority priority = Priority::normal) : priority{priority} {}
+
+    // the priority class of the operation
+    Priority priority;
+    // the operation is not performed if the token is cancelled or the deadline passes before a worker starts it:
+    // the handler then receives ErrorCode::stopped, and the filesystem is not touched. The token is only read
+    // at submission (the operation shares its state), so it need not outlive the call
+    const CancellationToken* token = nullptr;
+    Deadline deadline = Deadline::max();
+    // the handler of a write is invoked only once the data is durable as requested (ignored by the reads).
+    // The syncs are shared: the worker performs a single fdatasync per file and a single fsync per directory
+    // for all the writes completed within the sync window, and then invokes all their handlers.
+    // If the sync fails, the handlers receive ErrorCode::write_failure even though the data has been written
+    Durability durability = Durability::none;
+    // read, write or append the whole file with O_DIRECT, bypassing the page cache; meant for data that is not
+    // going to be read again soon, e.g. swap files and bulk transfers (ignored by the other operations)
+    bool direct_io = false;
+};
+
 // fwd declaration
 struct ChunkedFstreamInterface;
 
@@ -267,6 +321,29 @@ public:
     virtual void async_append(const Path&p, const Buffer &buf, FilesystemManagerInterface::CompletionHandler h)=0;
 
 
+    /*
+     * Overloads of the asynchronous operations submitted with a priority class;
+     * implementations that do not support priorities perform them as the plain ones.
+     */
+
+    virtual void async_read(const Path& p, Buffer& buf, CompletionHandler h, Priority) { async_read(p, buf, std::move(h)); }
+
+    virtual void async_write(const Path& p, const Buffer& buf, CompletionHandler h, Priority) { async_write(p, buf, std::move(h)); }
+
+    virtual void async_append(const Path& p, const Buffer& buf, CompletionHandler h, Priority) { async_append(p, buf, std::move(h)); }
+
+    /*
+     * Overloads of the asynchronous operations submitted with the given options;
+     * implementations that do not support them perform the operations with their priority class only.
+     */
+
+    virtual void async_read(const Path& p, Buffer& buf, CompletionHandler h, const SubmitOptions& opts) { async_read(p, buf, std::move(h), opts.priority); }
+
+    virtual void async_write(const Path& p, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts) { async_write(p, buf, std::move(h), opts.priority); }
+
+    virtual void async_append(const Path& p, const Buffer& buf, CompletionHandler h, const SubmitOptions& opts) { async_append(p, buf, std::move(h), opts.priority); }
+
+
 
     /**
      * @brief make_chunked_stream
@@ -0,0 +1,343 @@
+#include "path_checks.h"
+#include "fs_manager_uring.h"
+#include "fs_operations.h"
+#include "metadata_cache.h"
+#include <cassert>
+
+#ifdef CYNNYPP_HAS_IO_URING
+#include "posix_file.h"
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#endif
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+
+using boost::filesystem::file_type;
+
+#ifndef CYNNYPP_HAS_IO_URING
+
+FilesystemManager::UringContext::UringContext()
+{
+    throw ErrorCode(ErrorCode::internal_failure, "the io_uring backend is not available on this system");
+}
+
+FilesystemManager::UringContext::~UringContext() {}
+
+void FilesystemManager::UringContext::run(FilesystemManager&, Worker&) {}
+
+void FilesystemManager::UringContext::notify() {}
+
+#else
+
+namespace {
+
+// number of entries of the submission queue of each ring
+constexpr unsigned ring_entries = 256;
+// maximum number of operations popped from the queues in a single iteration of the loop
+constexpr size_t max_batch = 64;
+// user_data reserved to the poll on the wakeup eventfd
+constexpr uint64_t wakeup_tag = 0;
+// maximum length of a single transfer
+constexpr size_t max_transfer = 1 << 30;
+
+}
+
+/**
+ * @brief The Request struct tracks a read, write, append or chunk read whose transfer is in flight.
+ *
+ * The transfer is performed on fd, from offset on; fd is the one of file, opened for the operation,
+ * except for the chunk reads, which use the descriptor of their ChunkedReader.
+ */
+struct FilesystemManager::UringContext::Request {
+    std::unique_ptr<Operation> op;
+    impl::File file;
+    int fd;
+    uint64_t offset;
+    uint8_t* data;
+    size_t size;
+    size_t done;
+};
+
+
+FilesystemManager::UringContext::UringContext()
+    : in_flight(0)
+    , wakeup_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+    , ring(ring_entries)
+{
+    if(wakeup_fd < 0)
+        throw ErrorCode(ErrorCode::internal_failure, std::string{"eventfd failed: "} + std::strerror(errno));
+}
+
+FilesystemManager::UringContext::~UringContext()
+{
+    if(wakeup_fd >= 0)
+        close(wakeup_fd);
+}
+
+void FilesystemManager::UringContext::notify()
+{
+    uint64_t one = 1;
+    // the write can only fail if the counter overflows, i.e. if the worker has already been notified
+    auto ret = write(wakeup_fd, &one, sizeof(one));
+    (void) ret;
+}
+
+void FilesystemManager::UringContext::arm_wakeup()
+{
+    io_uring_sqe* sqe;
+    while(!(sqe = ring.get_sqe()))
+        ring.submit();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wakeup_fd;
+    sqe->poll_events = POLLIN;
+    sqe->user_data = wakeup_tag;
+}
+
+void FilesystemManager::UringContext::run(FilesystemManager& fs, Worker& w)
+{
+    // one entry of the completion queue is reserved to the wakeup poll
+    const size_t max_in_flight = ring.cq_entries() - 1;
+    bool wakeup_armed = false;
+
+    while(!fs.done_ || in_flight) {
+        bool more = false;
+        if(!fs.done_) {
+            if(!wakeup_armed) {
+                // consume the notifications before looking at the queue, so that none is lost
+                uint64_t value;
+                auto ret = read(wakeup_fd, &value, sizeof(value));
+                (void) ret;
+                arm_wakeup();
+                wakeup_armed = true;
+            }
+
+            // the chunk reads parked until their reader is ready go back to the queues
+            resume_parked(w);
+            // pop only while there is room to dispatch: the operations left on the queues are still served
+            // by priority class as soon as some transfers complete
+            size_t n = 0;
+            while(n < max_batch && in_flight < max_in_flight) {
+                auto op = w.pop(fs.priority_aging_);
+                if(!op)
+                    break;
+                dispatch(fs, w, std::move(op));
+                ++n;
+            }
+            // nobody notifies the operations left on the queues if the batch has been cut short
+            more = n == max_batch && in_flight < max_in_flight;
+            // perform the pending syncs before going to sleep, or when their window expires
+            fs.sync_pending(w, !more);
+        }
+        // the handlers must not wait for the next completions while the worker sleeps
+        fs.flush_completions(w, !more);
+
+        // the eventfd is written only while the worker sleeps: if it has been notified since it last woke up,
+        // look at the queue again instead
+        bool sleep = !more && w.wakeup.prepare_wait();
+        int ret = ring.submit(sleep ? 1 : 0);
+        if(sleep)
+            w.wakeup.finish_wait();
+        if(ret < 0 && ret != -EAGAIN && ret != -EBUSY && ret != -EINTR)
+            throw ErrorCode(ErrorCode::internal_failure, std::string{"io_uring_enter failed: "} + std::strerror(-ret));
+
+        ring.for_each_cqe([this, &fs, &w, &wakeup_armed](uint64_t user_data, int res) {
+            if(user_data == wakeup_tag)
+                wakeup_armed = false;
+            else
+                complete(fs, w, reinterpret_cast<Request*>(user_data), res);
+        });
+    }
+    fs.sync_pending(w, true);
+    fs.flush_completions(w, true);
+}
+
+void FilesystemManager::UringContext::dispatch(FilesystemManager& fs, Worker& w, std::unique_ptr<Operation> op)
+{
+    // keep the order of the operations on the same path
+    if(!op->path.empty()) {
+        auto it = busy.find(op->path);
+        if(it != busy.end()) {
+            it->second.push_back(std::move(op));
+            return;
+        }
+    }
+
+    switch(op->code) {
+    case OperationCode::async_read_chunk:
+        // the descriptor of a ChunkedReader is never opened for direct I/O
+        start(fs, w, std::move(op));
+        break;
+    case OperationCode::async_read:
+    case OperationCode::async_write:
+    case OperationCode::async_append:
+        // direct transfers need aligned buffers and whole blocks: leave them to the synchronous path
+        if(!op->direct_io) {
+            start(fs, w, std::move(op));
+            break;
+        }
+        // fall through
+    default:
+        // the syncs and the handlers must not wait for a long operation performed synchronously (see process_queue)
+        if(!is_short(*op)) {
+            fs.sync_pending(w, true);
+            fs.flush_completions(w, true);
+        }
+        fs.perform_operation(w, std::move(op));
+        break;
+    }
+}
+
+void FilesystemManager::UringContext::start(FilesystemManager& fs, Worker& w, std::unique_ptr<Operation> op)
+{
+    if(park(w, op))
+        return;
+    fs.mark_started(*op);
+    if(fs.discard_stopped(w, op))
+        return;
+
+    std::unique_ptr<Request> r{new Request{nullptr, impl::File{}, -1, 0, nullptr, 0, 0}};
+    try {
+        switch(op->code) {
+        case OperationCode::async_read: {
+            check_path_admitted<file_type::regular_file, file_type::symlink_file>(op->path, fs.metadata_.get());
+            r->file = impl::File(op->path, O_RDONLY);
+            if(!r->file)
+                throw ErrorCode(ErrorCode::open_failure, "async_read was not able to open the file " + op->path + " in read mode");
+            auto size = r->file.size();
+            if(size < 0)
+                throw ErrorCode(ErrorCode::read_failure, "async_read was not able to get the size of the file " + op->path);
+            auto& buf = static_cast<ReadOperation&>(*op).buf;
+            buf.resize(size);
+            r->data = buf.data();
+            r->size = buf.size();
+        } break;
+        case OperationCode::async_write:
+        case OperationCode::async_append: {
+            check_path_admitted<file_type::file_not_found, file_type::regular_file>(op->path, fs.metadata_.get());
+            int flags = O_WRONLY | O_CREAT | (op->code == OperationCode::async_write ? O_TRUNC : O_APPEND);
+            r->file = impl::File(op->path, flags);
+            if(!r->file)
+                throw ErrorCode(ErrorCode::open_failure, "async_write was not able to open the file " + op->path + " in write mode");
+            const auto& buf = static_cast<WriteOperation&>(*op).buf;
+            r->data = const_cast<uint8_t*>(buf.data());
+            r->size = buf.size();
+        } break;
+        case OperationCode::async_read_chunk: {
+            auto& t = static_cast<ChunkReadOperation&>(*op);
+            if(t.reader->is_stopped())
+                throw ErrorCode(ErrorCode::stopped);
+            r->fd = t.reader->file().fd();
+            r->offset = t.pos;
+            r->data = t.buf.data();
+            r->size = t.buf.size();
+        } break;
+        default:
+            assert(0);
+            break;
+        }
+    }
+    catch(const ErrorCode& e) {
+        if(op->code != OperationCode::async_read && op->code != OperationCode::async_read_chunk)
+            fs.forget(op->path);
+        fs.complete(w, *op, std::move(op->handler), e, size_t{0});
+        return;
+    }
+
+    if(r->file)
+        r->fd = r->file.fd();
+    // nothing to transfer
+    if(r->size == 0 && op->code != OperationCode::async_read_chunk) {
+        if(op->code != OperationCode::async_read)
+            fs.record_write(op->path, op->code, 0);
+        fs.complete(w, *op, std::move(op->handler), ErrorCode{ErrorCode::success}, size_t{0});
+        return;
+    }
+
+    busy[op->path];
+    r->op = std::move(op);
+    ++in_flight;
+    submit_transfer(r.release());
+}
+
+void FilesystemManager::UringContext::submit_transfer(Request* r)
+{
+    io_uring_sqe* sqe;
+    while(!(sqe = ring.get_sqe()))
+        ring.submit();
+
+    bool read = r->op->code == OperationCode::async_read || r->op->code == OperationCode::async_read_chunk;
+    sqe->opcode = read ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = r->fd;
+    sqe->addr = reinterpret_cast<uint64_t>(r->data + r->done);
+    sqe->len = static_cast<uint32_t>(std::min(r->size - r->done, max_transfer));
+    // appends are written at the end of the file (the file is opened with O_APPEND)
+    sqe->off = r->op->code == OperationCode::async_append ? static_cast<uint64_t>(-1) : r->offset + r->done;
+    sqe->user_data = reinterpret_cast<uint64_t>(r);
+}
+
+void FilesystemManager::UringContext::complete(FilesystemManager& fs, Worker& w, Request* req, int res)
+{
+    std::unique_ptr<Request> r{req};
+    const auto code = r->op->code;
+
+    ErrorCode ec{ErrorCode::success};
+    if(res < 0 || (res == 0 && code == OperationCode::async_read)) {
+        std::string reason = res < 0 ? std::strerror(-res) : "unexpected end of file";
+        if(code == OperationCode::async_read)
+            ec = ErrorCode(ErrorCode::read_failure, "async_read was not able to read from " + r->op->path + ": " + reason);
+        else if(code == OperationCode::async_read_chunk)
+            ec = ErrorCode(ErrorCode::read_failure, "async_read_chunk was not able to read from " + r->op->path + ": " + reason);
+        else if(code == OperationCode::async_write)
+            ec = ErrorCode(ErrorCode::write_failure, "async_write was not able to write to " + r->op->path + ": " + reason);
+        else
+            ec = ErrorCode(ErrorCode::append_failure, "async_append was not able to append to " + r->op->path + ": " + reason);
+    }
+    else {
+        r->done += res;
+        // a chunk read ends early at the end of the file
+        if(r->done < r->size && !(res == 0 && code == OperationCode::async_read_chunk)) {
+            // short transfer: go on with the rest
+            submit_transfer(r.release());
+            return;
+        }
+    }
+
+    r->file.close();
+    --in_flight;
+    size_t size = ec ? 0 : r->size;
+    if(code == OperationCode::async_read_chunk) {
+        auto& t = static_cast<ChunkReadOperation&>(*r->op);
+        if(!ec) {
+            t.reader->chunk_read(t.buf, r->done);
+            t.buf.set_hot(true);
+            ec = t.buf.error_code() = r->done == r->size && !t.reader->eof() ? ErrorCode::success : ErrorCode::end_of_file;
+            size = r->done;
+        }
+    }
+    else if(code != OperationCode::async_read) {
+        if(ec)
+            fs.forget(r->op->path);
+        else
+            fs.record_write(r->op->path, code, r->size);
+    }
+    fs.complete(w, *r->op, std::move(r->op->handler), ec, size);
+
+    // dispatch, in order, the operations that were waiting for this one
+    auto it = busy.find(r->op->path);
+    auto waiting = std::move(it->second);
+    busy.erase(it);
+    for(auto& op : waiting)
+        dispatch(fs, w, std::move(op));
+}
+
+#endif // CYNNYPP_HAS_IO_URING
+
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
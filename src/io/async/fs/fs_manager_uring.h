@@ -0,0 +1,71 @@
+#ifndef CYNNYPP_FS_MANAGER_URING_H
+#define CYNNYPP_FS_MANAGER_URING_H
+
+#include "fs_manager.h"
+#include "uring.h"
+#include <deque>
+#include <unordered_map>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+
+/**
+ * @brief The UringContext struct holds the state of a worker of the io_uring backend
+ * and implements its loop.
+ *
+ * Reads, writes, appends and chunk reads are started on the worker thread (path checks and open are
+ * performed synchronously) and their transfers are submitted to the ring, so that many
+ * of them can be in flight at the same time; any other operation, as well as any read, write
+ * or append submitted with SubmitOptions::direct_io, is performed synchronously.
+ * While an operation on a path is in flight, the following operations on the same path are
+ * kept aside and dispatched in order when it completes; a chunk read that cannot start yet is parked
+ * until its reader is ready (see FilesystemManager::park).
+ *
+ * The worker sleeps inside io_uring_enter, waiting both for completions and for an eventfd
+ * that is signaled by FilesystemManager::wake; the eventfd is written only when the Wakeup
+ * of the worker tells that it is asleep, so that a busy worker costs no system call to its producers.
+ */
+struct FilesystemManager::UringContext {
+    /**
+     * @throws ErrorCode::internal_failure if io_uring is not available
+     */
+    UringContext();
+    UringContext(const UringContext&) = delete;
+    UringContext& operator=(const UringContext&) = delete;
+    ~UringContext();
+
+    /**
+     * @brief run is the loop of the worker thread; it returns when the FilesystemManager is
+     * stopped and all the transfers in flight have completed.
+     */
+    void run(FilesystemManager& fs, Worker& w);
+
+    /**
+     * @brief notify wakes up the worker thread, once Wakeup::signal has returned true; it can be invoked by any thread.
+     */
+    void notify();
+
+#ifdef CYNNYPP_HAS_IO_URING
+private:
+    struct Request;
+
+    void dispatch(FilesystemManager& fs, Worker& w, std::unique_ptr<Operation> op);
+    void start(FilesystemManager& fs, Worker& w, std::unique_ptr<Operation> op);
+    void submit_transfer(Request* r);
+    void complete(FilesystemManager& fs, Worker& w, Request* r, int res);
+    void arm_wakeup();
+
+    // operations waiting for the one in flight on the same path
+    std::unordered_map<Path, std::deque<std::unique_ptr<Operation>>> busy;
+    size_t in_flight;
+    int wakeup_fd;
+    impl::Uring ring;
+#endif
+};
+
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_MANAGER_URING_H
@@ -0,0 +1,178 @@
+#ifndef CYNNYPP_FS_OPERATIONS_H
+#define CYNNYPP_FS_OPERATIONS_H
+
+#include "fs_manager.h"
+// the records hold uint8_t streams: the codecvt specialization must be visible
+#include "io/locales.h"
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+
+namespace impl {
+
+/**
+ * @brief The FileCopy struct describes one of the files copied by a recursive directory copy.
+ */
+struct FileCopy {
+    Path from;
+    Path to;
+    uintmax_t size;
+};
+
+}
+
+// -----------------------------------------------------------------------------------------------
+// records of the asynchronous operations
+// -----------------------------------------------------------------------------------------------
+
+// async_read
+struct FilesystemManager::ReadOperation : FilesystemManager::Operation {
+    ReadOperation(const Path& path, Buffer& buf, CompletionHandler h)
+        : Operation{OperationCode::async_read, path, std::move(h)}, buf(buf)
+    {}
+    Buffer& buf;
+};
+
+// async_write, async_append and async_write_atomic
+struct FilesystemManager::WriteOperation : FilesystemManager::Operation {
+    WriteOperation(OperationCode code, const Path& path, const Buffer& buf, CompletionHandler h)
+        : Operation{code, path, std::move(h)}, buf(buf)
+    {}
+    const Buffer& buf;
+};
+
+// fd_async_read
+struct FilesystemManager::StreamReadOperation : FilesystemManager::Operation {
+    StreamReadOperation(std::unique_ptr<std::basic_ifstream<uint8_t>> in, Buffer& buf, CompletionHandler h)
+        : Operation{OperationCode::fd_async_read, {}, std::move(h)}, in{std::move(in)}, buf(buf)
+    {}
+    std::unique_ptr<std::basic_ifstream<uint8_t>> in;
+    Buffer& buf;
+};
+
+// async_read_chunk
+struct FilesystemManager::ChunkReadOperation : FilesystemManager::Operation {
+    ChunkReadOperation(std::shared_ptr<impl::ChunkedReader> r, size_t pos, impl::HotDoubleBuffer::BufferView& buf, CompletionHandler h)
+        : Operation{OperationCode::async_read_chunk, r->file_path(), std::move(h)}, reader{std::move(r)}, pos{pos}, buf(buf)
+    {}
+    std::shared_ptr<impl::ChunkedReader> reader;
+    size_t pos;
+    impl::HotDoubleBuffer::BufferView buf;
+};
+
+// async_writev
+struct FilesystemManager::GatherWriteOperation : FilesystemManager::Operation {
+    GatherWriteOperation(const Path& path, const ConstBuffers& bufs, CompletionHandler h)
+        : Operation{OperationCode::async_writev, path, std::move(h)}, size{0}
+    {
+        iov.reserve(bufs.size());
+        for(const auto& b : bufs) {
+            iov.push_back({const_cast<void*>(boost::asio::buffer_cast<const void*>(b)), boost::asio::buffer_size(b)});
+            size += iov.back().iov_len;
+        }
+    }
+    std::vector<struct iovec> iov;
+    size_t size;
+};
+
+// async_readv
+struct FilesystemManager::ScatterReadOperation : FilesystemManager::Operation {
+    ScatterReadOperation(const Path& path, uint64_t offset, const MutableBuffers& bufs, CompletionHandler h)
+        : Operation{OperationCode::async_readv, path, std::move(h)}, offset{offset}
+    {
+        iov.reserve(bufs.size());
+        for(const auto& b : bufs)
+            iov.push_back({boost::asio::buffer_cast<void*>(b), boost::asio::buffer_size(b)});
+    }
+    uint64_t offset;
+    std::vector<struct iovec> iov;
+};
+
+// async_pread
+struct FilesystemManager::PositionalReadOperation : FilesystemManager::Operation {
+    PositionalReadOperation(const Path& path, uint64_t offset, size_t length, Buffer& buf, CompletionHandler h)
+        : Operation{OperationCode::async_pread, path, std::move(h)}, offset{offset}, length{length}, buf(buf)
+    {}
+    uint64_t offset;
+    size_t length;
+    Buffer& buf;
+};
+
+// async_pwrite
+struct FilesystemManager::PositionalWriteOperation : FilesystemManager::Operation {
+    PositionalWriteOperation(const Path& path, uint64_t offset, const Buffer& buf, CompletionHandler h)
+        : Operation{OperationCode::async_pwrite, path, std::move(h)}, offset{offset}, buf(buf)
+    {}
+    uint64_t offset;
+    const Buffer& buf;
+};
+
+// async_map_file
+struct FilesystemManager::MapOperation : FilesystemManager::Operation {
+    MapOperation(const Path& path, std::shared_ptr<const MappedRegion>& region, CompletionHandler h)
+        : Operation{OperationCode::async_map_file, path, std::move(h)}, region(region)
+    {}
+    std::shared_ptr<const MappedRegion>& region;
+};
+
+// async_copy_file, also used for the files of async_copy_directory, which are not overwritten
+struct FilesystemManager::CopyOperation : FilesystemManager::Operation {
+    CopyOperation(const Path& from, const Path& to, bool overwrite, CompletionHandler h)
+        : Operation{OperationCode::async_copy_file, from, std::move(h)}, to{to}, overwrite{overwrite}
+    {}
+    Path to;
+    bool overwrite;
+};
+
+// async_copy_directory: creates the directory tree and collects the files to be copied
+struct FilesystemManager::DirectoryScanOperation : FilesystemManager::Operation {
+    DirectoryScanOperation(const Path& from, const Path& to, std::vector<impl::FileCopy>& files, CompletionHandler h)
+        : Operation{OperationCode::async_copy_directory, from, std::move(h)}, to{to}, files(files)
+    {}
+    Path to;
+    std::vector<impl::FileCopy>& files;
+};
+
+/**
+ * @brief The DirectoryCopy struct is the state of an async_copy_directory: once the directory tree has been
+ * created, the files are copied by the workers, keeping at most max_in_flight copies at the same time.
+ *
+ * It is only accessed by the completion handlers, i.e. by the thread running the io_service.
+ */
+struct FilesystemManager::DirectoryCopy {
+    DirectoryCopy(size_t max_in_flight, Priority priority, CompletionHandler h, ProgressHandler on_progress)
+        : next{0}, in_flight{0}, max_in_flight{max_in_flight}, priority{priority}, progress{}
+        , handler{std::move(h)}, on_progress{std::move(on_progress)}
+    {}
+
+    std::vector<impl::FileCopy> files;
+    size_t next;
+    size_t in_flight;
+    const size_t max_in_flight;
+    const Priority priority;
+    CopyProgress progress;
+    ErrorCode ec;
+    CompletionHandler handler;
+    ProgressHandler on_progress;
+};
+
+/**
+ * @brief The Batch struct is the state of an async_batch: every operation stores its result
+ * in its own slot, on the worker thread, and the last one to complete posts the handler.
+ */
+struct FilesystemManager::Batch {
+    Batch(size_t n, BatchHandler h)
+        : results(n, BatchResult{ErrorCode{ErrorCode::unknown_error}, 0}), remaining{n}, handler{std::move(h)}
+    {}
+
+    std::vector<BatchResult> results;
+    std::atomic<size_t> remaining;
+    BatchHandler handler;
+};
+
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_OPERATIONS_H
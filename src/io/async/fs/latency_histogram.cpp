@@ -0,0 +1,85 @@
+#include "latency_histogram.h"
+#include <algorithm>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+constexpr unsigned LatencyHistogram::sub_bits;
+constexpr unsigned LatencyHistogram::max_bits;
+constexpr size_t LatencyHistogram::n_buckets;
+
+LatencyHistogram::LatencyHistogram()
+    : count{0}, sum{0}, max{0}
+{
+    for(auto& c : counts)
+        c.store(0, std::memory_order_relaxed);
+}
+
+size_t LatencyHistogram::bucket(uint64_t ns)
+{
+    constexpr uint64_t sub_buckets = uint64_t{1} << sub_bits;
+    if(ns < sub_buckets)
+        return ns;
+    ns = std::min(ns, (uint64_t{1} << max_bits) - 1);
+    // position of the most significant bit, followed by the sub_bits bits after it
+    unsigned msb = 63 - __builtin_clzll(ns);
+    return ((msb - sub_bits + 1) << sub_bits) + ((ns >> (msb - sub_bits)) & (sub_buckets - 1));
+}
+
+uint64_t LatencyHistogram::upper_bound(size_t i)
+{
+    constexpr uint64_t sub_buckets = uint64_t{1} << sub_bits;
+    if(i < sub_buckets)
+        return i;
+    unsigned msb = (i >> sub_bits) + sub_bits - 1;
+    uint64_t lower = (sub_buckets + (i & (sub_buckets - 1))) << (msb - sub_bits);
+    return lower + (uint64_t{1} << (msb - sub_bits)) - 1;
+}
+
+void LatencyHistogram::record(Duration d)
+{
+    uint64_t ns = d.count() > 0 ? static_cast<uint64_t>(d.count()) : 0;
+    counts[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(ns, std::memory_order_relaxed);
+    auto m = max.load(std::memory_order_relaxed);
+    while(ns > m && !max.compare_exchange_weak(m, ns, std::memory_order_relaxed));
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot s;
+    s.count = count.load(std::memory_order_relaxed);
+    if(s.count == 0)
+        return s;
+    s.sum = sum.load(std::memory_order_relaxed);
+    s.max = max.load(std::memory_order_relaxed);
+    s.buckets.resize(n_buckets);
+    for(size_t i = 0; i < n_buckets; ++i)
+        s.buckets[i] = counts[i].load(std::memory_order_relaxed);
+    return s;
+}
+
+LatencyHistogram::Duration LatencyHistogram::Snapshot::percentile(double q) const
+{
+    if(buckets.empty())
+        return Duration(0);
+    uint64_t total = 0;
+    for(auto c : buckets)
+        total += c;
+    uint64_t rank = static_cast<uint64_t>(std::max(0.0, std::min(q, 1.0)) * total);
+    uint64_t seen = 0;
+    for(size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if(seen > rank || (seen == total && seen > 0))
+            return Duration(std::min(upper_bound(i), max));
+    }
+    return Duration(max);
+}
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
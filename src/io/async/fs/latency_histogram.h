@@ -0,0 +1,83 @@
+#ifndef CYNNYPP_FS_LATENCY_HISTOGRAM_H
+#define CYNNYPP_FS_LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+/**
+ * @brief The LatencyHistogram class counts durations in log-linear buckets, as HDR histograms do: every power of two
+ * is split into 16 buckets, so that any duration is known within 1/16 of its value, from nanoseconds up to
+ * about 18 minutes (longer durations are counted in the last bucket).
+ *
+ * Recording is wait-free and can be performed by any thread; a snapshot taken while others record
+ * may miss the most recent values, but it is never corrupted.
+ */
+class LatencyHistogram {
+public:
+    using Duration = std::chrono::nanoseconds;
+
+    /**
+     * @brief The Snapshot struct is a copy of the content of a LatencyHistogram at some point.
+     */
+    struct Snapshot {
+        uint64_t count = 0;
+        // sum and maximum of the durations recorded, in nanoseconds
+        uint64_t sum = 0;
+        uint64_t max = 0;
+        // number of durations recorded in each bucket, empty if none was recorded
+        std::vector<uint64_t> buckets;
+
+        Duration mean() const { return Duration(count ? sum / count : 0); }
+
+        /**
+         * @brief percentile returns a duration that is not exceeded by the fraction q (between 0 and 1)
+         * of the durations recorded, overestimated by at most 1/16; it is 0 if none was recorded.
+         */
+        Duration percentile(double q) const;
+    };
+
+    LatencyHistogram();
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    void record(Duration d);
+
+    Snapshot snapshot() const;
+
+    // number of buckets of each power of two, as a power of two
+    static constexpr unsigned sub_bits = 4;
+    // durations are counted up to 2^max_bits nanoseconds
+    static constexpr unsigned max_bits = 40;
+    static constexpr size_t n_buckets = (max_bits - sub_bits + 1) << sub_bits;
+
+    /**
+     * @brief bucket returns the index of the bucket in which the duration of ns nanoseconds is counted.
+     */
+    static size_t bucket(uint64_t ns);
+
+    /**
+     * @brief upper_bound returns the longest duration, in nanoseconds, counted in the bucket i.
+     */
+    static uint64_t upper_bound(size_t i);
+
+private:
+    std::array<std::atomic<uint64_t>, n_buckets> counts;
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+};
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_LATENCY_HISTOGRAM_H
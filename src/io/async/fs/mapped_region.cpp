@@ -0,0 +1,68 @@
+#include "path_checks.h"
+#include "mapped_region.h"
+#include "posix_file.h"
+#include <sys/mman.h>
+#include <algorithm>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+
+using boost::filesystem::file_type;
+
+MappedRegion::MappedRegion(const Path& p)
+    : data_{nullptr}
+    , size_{0}
+{
+    // check and throw if needed
+    check_path_admitted<file_type::regular_file, file_type::symlink_file>(p);
+
+    impl::File f(p, O_RDONLY);
+    if(!f)
+        throw ErrorCode(ErrorCode::open_failure, "MappedRegion was not able to open the file " + p + " in read mode");
+
+    auto size = f.size();
+    if(size < 0)
+        throw ErrorCode(ErrorCode::read_failure, "MappedRegion was not able to get the size of the file " + p + ": " + impl::last_error());
+    // an empty file cannot be mapped
+    if(size == 0)
+        return;
+
+    // the mapping outlives the descriptor, which is closed on return
+    auto addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, f.fd(), 0);
+    if(addr == MAP_FAILED)
+        throw ErrorCode(ErrorCode::read_failure, "MappedRegion was not able to map the file " + p + ": " + impl::last_error());
+
+    data_ = static_cast<const uint8_t*>(addr);
+    size_ = size;
+}
+
+MappedRegion::~MappedRegion()
+{
+    if(data_)
+        munmap(const_cast<uint8_t*>(data_), size_);
+}
+
+bool MappedRegion::advise(Advice a, size_t offset, size_t length) const
+{
+    if(offset >= size_)
+        return empty();
+    length = std::min(length, size_ - offset);
+
+    int advice = MADV_NORMAL;
+    switch(a) {
+    case Advice::normal: advice = MADV_NORMAL; break;
+    case Advice::sequential: advice = MADV_SEQUENTIAL; break;
+    case Advice::random: advice = MADV_RANDOM; break;
+    case Advice::willneed: advice = MADV_WILLNEED; break;
+    case Advice::dontneed: advice = MADV_DONTNEED; break;
+    }
+
+    // madvise wants a page aligned address: the mapping itself is page aligned
+    auto head = offset % pageSize;
+    return madvise(const_cast<uint8_t*>(data_) + offset - head, length + head, advice) == 0;
+}
+
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
@@ -0,0 +1,64 @@
+#ifndef CYNNYPP_FS_MAPPED_REGION_H
+#define CYNNYPP_FS_MAPPED_REGION_H
+
+#include "fs_manager_interface.h"
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+
+/**
+ * @brief The MappedRegion class is a read-only view of a whole file, mapped in memory with mmap.
+ *
+ * The pages of the view are the pages of the page cache: any number of readers can share
+ * a region (it is handed out through a shared_ptr) without copying the file content.
+ * The file is unmapped when the last reference to the region is released.
+ * Changes made to the file while it is mapped are visible through the view; truncating
+ * the file while it is mapped makes the access to the truncated pages raise SIGBUS.
+ */
+class MappedRegion {
+public:
+    /**
+     * @brief The Advice enum lists the hints that can be given to the kernel about
+     * how the region is going to be accessed (see madvise(2)).
+     */
+    enum class Advice {
+        normal, sequential, random, willneed, dontneed
+    };
+
+    /**
+     * @brief Map the whole file p; an empty file gives an empty region.
+     *
+     * \throws If some filesystem error occurs, or if p is a symlink or not a regular file, a FilesystemError is thrown
+     */
+    explicit MappedRegion(const Path& p);
+    MappedRegion(const MappedRegion&) = delete;
+    MappedRegion& operator=(const MappedRegion&) = delete;
+    ~MappedRegion();
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const uint8_t* begin() const { return data_; }
+    const uint8_t* end() const { return data_ + size_; }
+
+    /**
+     * @brief advise gives a hint to the kernel about the access pattern of (a part of) the region.
+     * @param a the hint
+     * @param offset the beginning of the part of the region the hint refers to
+     * @param length the length of that part; by default, up to the end of the region
+     * @return true if the hint was accepted
+     */
+    bool advise(Advice a, size_t offset = 0, size_t length = static_cast<size_t>(-1)) const;
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+};
+
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_MAPPED_REGION_H
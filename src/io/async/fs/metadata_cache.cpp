@@ -0,0 +1,114 @@
+#include "metadata_cache.h"
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+using boost::filesystem::file_type;
+
+static file_type type_of(mode_t mode)
+{
+    if(S_ISREG(mode)) return file_type::regular_file;
+    if(S_ISDIR(mode)) return file_type::directory_file;
+    if(S_ISLNK(mode)) return file_type::symlink_file;
+    if(S_ISBLK(mode)) return file_type::block_file;
+    if(S_ISCHR(mode)) return file_type::character_file;
+    if(S_ISFIFO(mode)) return file_type::fifo_file;
+    if(S_ISSOCK(mode)) return file_type::socket_file;
+    return file_type::type_unknown;
+}
+
+Metadata MetadataCache::lookup(const Path& p)
+{
+    auto now = Clock::now();
+    uint64_t seen;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto it = entries.find(p);
+        if(it != entries.end() && it->second.expiry > now)
+            return it->second.m;
+        seen = generation;
+    }
+
+    // inspect the path out of the lock, as symlink_status would do
+    Metadata m{file_type::file_not_found, 0};
+    struct stat st;
+    if(lstat(p.c_str(), &st) == 0)
+        m = Metadata{type_of(st.st_mode), static_cast<uintmax_t>(st.st_size)};
+    else if(errno != ENOENT && errno != ENOTDIR)
+        throw ErrorCode(ErrorCode::internal_failure, "could not get the status of \"" + p + "\": " + std::strerror(errno));
+
+    // a store, grown, erase or invalidate performed meanwhile may be more recent than what lstat saw
+    std::lock_guard<std::mutex> lock(mtx);
+    if(generation == seen)
+        insert(p, m, now);
+    return m;
+}
+
+void MetadataCache::store(const Path& p, Metadata m)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    ++generation;
+    insert(p, m, Clock::now());
+}
+
+void MetadataCache::grown(const Path& p, uintmax_t n)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    ++generation;
+    auto it = entries.find(p);
+    if(it == entries.end())
+        return;
+
+    auto& m = it->second.m;
+    if(m.type == file_type::regular_file)
+        m.size += n;
+    else if(m.type == file_type::file_not_found)
+        m = Metadata{file_type::regular_file, n};
+    else
+        entries.erase(it);
+}
+
+void MetadataCache::erase(const Path& p)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    ++generation;
+    entries.erase(p);
+}
+
+void MetadataCache::invalidate(const Path& p)
+{
+    auto base = p;
+    while(base.size() > 1 && base.back() == '/')
+        base.pop_back();
+
+    std::lock_guard<std::mutex> lock(mtx);
+    ++generation;
+    entries.erase(base);
+    // the paths below base are those between base + '/' and base + '0', the character following '/'
+    entries.erase(entries.lower_bound(base + '/'), entries.lower_bound(base + '0'));
+}
+
+void MetadataCache::insert(const Path& p, Metadata m, Clock::time_point now)
+{
+    if(entries.size() >= capacity && !entries.count(p)) {
+        for(auto it = entries.begin(); it != entries.end();) {
+            if(it->second.expiry <= now)
+                it = entries.erase(it);
+            else
+                ++it;
+        }
+        if(entries.size() >= capacity)
+            entries.clear();
+    }
+    entries[p] = Entry{m, now + ttl};
+}
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
@@ -0,0 +1,115 @@
+#ifndef CYNNYPP_FS_METADATA_CACHE_H
+#define CYNNYPP_FS_METADATA_CACHE_H
+
+#include "path_checks.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+/**
+ * @brief The Metadata struct is what the MetadataCache knows about a path: its type, as reported
+ * by symlink_status (file_not_found if it does not exist), and its size, meaningful for regular files only.
+ */
+struct Metadata {
+    boost::filesystem::file_type type;
+    uintmax_t size;
+};
+
+/**
+ * @brief The MetadataCache class remembers the metadata of the paths checked by a FilesystemManager
+ * for a limited time, so that the checks performed before each operation do not stat the same path again and again.
+ *
+ * The FilesystemManager keeps it up to date with its own changes (write-through), dropping or updating the entries
+ * of the paths it modifies; changes made by anyone else are seen only when the entries expire.
+ * Paths are compared as strings, so the same file reached through different paths gets different entries.
+ *
+ * All the functions can be invoked by any thread.
+ */
+class MetadataCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @param ttl how long an entry is trusted after the path has been inspected
+     * @param capacity the maximum number of entries; when it is reached, the expired entries are dropped,
+     * and all of them if none is expired
+     */
+    explicit MetadataCache(Clock::duration ttl, size_t capacity = 65536) : ttl{ttl}, capacity{capacity} {}
+    MetadataCache(const MetadataCache&) = delete;
+    MetadataCache& operator=(const MetadataCache&) = delete;
+
+    /**
+     * @brief lookup returns the metadata of p, inspecting it (with lstat) only if no valid entry is cached.
+     *
+     * \throws ErrorCode::internal_failure if p cannot be inspected
+     */
+    Metadata lookup(const Path& p);
+
+    /**
+     * @brief store records the metadata of p, which has just been changed by the manager.
+     */
+    void store(const Path& p, Metadata m);
+
+    /**
+     * @brief grown records that n bytes have just been appended to p by the manager.
+     */
+    void grown(const Path& p, uintmax_t n);
+
+    /**
+     * @brief erase forgets the metadata of p only.
+     */
+    void erase(const Path& p);
+
+    /**
+     * @brief invalidate forgets the metadata of p and of all the paths below it.
+     */
+    void invalidate(const Path& p);
+
+private:
+    struct Entry {
+        Metadata m;
+        Clock::time_point expiry;
+    };
+
+    void insert(const Path& p, Metadata m, Clock::time_point now);
+
+    const Clock::duration ttl;
+    const size_t capacity;
+    std::mutex mtx;
+    // ordered, so that the paths below a directory are contiguous
+    std::map<Path, Entry> entries;
+    // incremented by every change made by the manager, so that lookup does not record what it inspected
+    // if the path may have been changed meanwhile
+    uint64_t generation = 0;
+};
+
+} // namespace impl
+
+
+/**
+ * @brief check_path_admitted checks whether the type of the path is among the admitted ones, as the overload
+ * without cache does, asking the metadata to the cache if one is given.
+ */
+template<boost::filesystem::file_type... Admitted>
+static boost::filesystem::file_status check_path_admitted(const boost::filesystem::path& p, impl::MetadataCache* cache)
+{
+    if(!cache)
+        return check_path_admitted<Admitted...>(p);
+
+    auto type = cache->lookup(p.native()).type;
+    if(!is_admitted<Admitted...>(type))
+        throw ErrorCode(ErrorCode::invalid_argument, std::string("path \"") + p.native() + "\" is not admitted");
+    return boost::filesystem::file_status(type);
+}
+
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_METADATA_CACHE_H
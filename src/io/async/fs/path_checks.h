@@ -0,0 +1,71 @@
+#ifndef CYNNYPP_FS_PATH_CHECKS_H
+#define CYNNYPP_FS_PATH_CHECKS_H
+
+#define BOOST_FILESYSTEM_NO_DEPRECATED
+#define GCC_VERSION (__GNUC__ * 10000 \
+                               + __GNUC_MINOR__ * 100 \
+                               + __GNUC_PATCHLEVEL__)
+/* Test for GCC > 3.2.0 */
+#if GCC_VERSION  < 50300
+#define BOOST_NO_CXX11_SCOPED_ENUMS
+#endif
+
+#include <boost/filesystem.hpp>
+#include "fs_manager_interface.h"
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+
+// -----------------------------------------------------------------------------------------------
+// is_admitted: check whether a file_type is among those specified in the template parameters pack
+// -----------------------------------------------------------------------------------------------
+template<boost::filesystem::file_type Admitted>
+static constexpr bool is_admitted(boost::filesystem::file_type t)
+{
+    return t == Admitted;
+}
+
+template<boost::filesystem::file_type Head, boost::filesystem::file_type... Tail>
+using enable_if_t = typename std::enable_if<sizeof...(Tail) != 0, bool>::type;
+
+template<boost::filesystem::file_type Head, boost::filesystem::file_type... Tail>
+static constexpr enable_if_t<Head, Tail...> is_admitted(boost::filesystem::file_type t)
+{
+    return t == Head || is_admitted<Tail...>(t);
+}
+
+
+// -----------------------------------------------------------------------------------------------
+// check_path_admitted: check whether the type of the path is among the admitted ones
+// -----------------------------------------------------------------------------------------------
+template<boost::filesystem::file_type... Admitted>
+static boost::filesystem::file_status check_path_admitted(const boost::filesystem::path& p)
+{
+    using boost::filesystem::file_type;
+
+    try {
+        auto status = boost::filesystem::symlink_status(p);
+        auto type = status.type();
+
+        // admit only file_not_found, regular_file or directory_file
+        if(!is_admitted<Admitted...>(type))
+        {
+            std::string msg = std::string("path \"") + p.native() + "\" is not admitted";
+            throw ErrorCode(ErrorCode::invalid_argument, msg);
+        }
+
+        return status;
+    }
+    // capture boosts exceptions to rethrow a FilesystemError
+    catch(boost::filesystem::filesystem_error& e)
+    {
+        throw ErrorCode(ErrorCode::internal_failure, e.what());
+    }
+}
+
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_PATH_CHECKS_H
@@ -0,0 +1,283 @@
+#include "posix_file.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#endif
+#include <climits>
+#include <atomic>
+#include <string>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+File::File(const Path& p, int flags, mode_t mode)
+    : fd_{-1}
+{
+    do {
+        fd_ = ::open(p.c_str(), flags | O_CLOEXEC, mode);
+    } while(fd_ < 0 && errno == EINTR);
+}
+
+File& File::operator=(File&& other) noexcept
+{
+    if(this != &other) {
+        close();
+        fd_ = other.fd_;
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+void File::close()
+{
+    if(fd_ >= 0)
+        ::close(fd_);
+    fd_ = -1;
+}
+
+off_t File::size() const
+{
+    struct stat st;
+    if(fstat(fd_, &st) < 0)
+        return -1;
+    return st.st_size;
+}
+
+ssize_t File::read_at(void* data, size_t len, off_t off) const
+{
+    auto p = static_cast<uint8_t*>(data);
+    size_t done = 0;
+    while(done < len) {
+        auto n = ::pread(fd_, p + done, len - done, off + done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0)
+            return -1;
+        if(n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+bool File::write_at(const void* data, size_t len, off_t off)
+{
+    auto p = static_cast<const uint8_t*>(data);
+    size_t done = 0;
+    while(done < len) {
+        auto n = ::pwrite(fd_, p + done, len - done, off + done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+bool File::write(const void* data, size_t len)
+{
+    auto p = static_cast<const uint8_t*>(data);
+    size_t done = 0;
+    while(done < len) {
+        auto n = ::write(fd_, p + done, len - done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+bool File::truncate(off_t size)
+{
+    int ret;
+    do {
+        ret = ftruncate(fd_, size);
+    } while(ret < 0 && errno == EINTR);
+    return ret == 0;
+}
+
+bool File::sync_data()
+{
+    return fdatasync(fd_) == 0;
+}
+
+bool File::sync()
+{
+    return fsync(fd_) == 0;
+}
+
+/*
+ * Skip the first n bytes of the buffers described by iov: the buffers transferred entirely
+ * are dropped and the one transferred partially is shrunk.
+ */
+static void advance(struct iovec*& iov, int& iovcnt, size_t n)
+{
+    while(iovcnt > 0 && n >= iov->iov_len) {
+        n -= iov->iov_len;
+        ++iov;
+        --iovcnt;
+    }
+    if(iovcnt > 0) {
+        iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + n;
+        iov->iov_len -= n;
+    }
+}
+
+size_t File::writev(struct iovec* iov, int iovcnt)
+{
+    size_t done = 0;
+    while(iovcnt > 0) {
+        auto n = ::writev(fd_, iov, std::min(iovcnt, IOV_MAX));
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        done += n;
+        advance(iov, iovcnt, n);
+    }
+    return done;
+}
+
+size_t File::writev_at(struct iovec* iov, int iovcnt, off_t off)
+{
+    size_t done = 0;
+    while(iovcnt > 0) {
+        auto n = ::pwritev(fd_, iov, std::min(iovcnt, IOV_MAX), off + done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            break;
+        done += n;
+        advance(iov, iovcnt, n);
+    }
+    return done;
+}
+
+ssize_t File::readv_at(struct iovec* iov, int iovcnt, off_t off) const
+{
+    size_t done = 0;
+    // empty buffers are skipped, so that a read returning 0 always means the end of the file
+    advance(iov, iovcnt, 0);
+    while(iovcnt > 0) {
+        auto n = ::preadv(fd_, iov, std::min(iovcnt, IOV_MAX), off + done);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0)
+            return -1;
+        if(n == 0)
+            break;
+        done += n;
+        advance(iov, iovcnt, n);
+    }
+    return done;
+}
+
+KernelCopy copy_in_kernel(const File& in, File& out, off_t size)
+{
+#ifdef __linux__
+#ifdef FICLONE
+    if(ioctl(out.fd(), FICLONE, in.fd()) == 0)
+        return KernelCopy::done;
+#endif
+#ifdef __NR_copy_file_range
+    off_t done = 0;
+    while(done < size) {
+        loff_t off_in = done, off_out = done;
+        auto n = syscall(__NR_copy_file_range, in.fd(), &off_in, out.fd(), &off_out, static_cast<size_t>(size - done), 0u);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n < 0) {
+            // these are returned before anything is copied when the kernel or the filesystems cannot do it
+            if(done == 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == EPERM))
+                return KernelCopy::unsupported;
+            return KernelCopy::failed;
+        }
+        // the file has been shrunk meanwhile
+        if(n == 0)
+            break;
+        done += n;
+    }
+    return KernelCopy::done;
+#endif
+#endif
+    (void) in; (void) out; (void) size;
+    return KernelCopy::unsupported;
+}
+
+Path temporary_name(const Path& p)
+{
+    static std::atomic<unsigned> counter{0};
+    return p + ".tmp." + std::to_string(getpid()) + "." + std::to_string(counter++);
+}
+
+File open_unnamed(const Path& dir)
+{
+#ifdef O_TMPFILE
+    return File(dir, O_TMPFILE | O_WRONLY);
+#else
+    (void) dir;
+    errno = EOPNOTSUPP;
+    return File();
+#endif
+}
+
+bool link_unnamed(const File& f, const Path& p)
+{
+    // linking the descriptor itself (AT_EMPTY_PATH) needs CAP_DAC_READ_SEARCH, its /proc entry does not
+    auto source = "/proc/self/fd/" + std::to_string(f.fd());
+    if(linkat(f.fd(), "", AT_FDCWD, p.c_str(), AT_EMPTY_PATH) == 0)
+        return true;
+    if(errno != EEXIST && linkat(AT_FDCWD, source.c_str(), AT_FDCWD, p.c_str(), AT_SYMLINK_FOLLOW) == 0)
+        return true;
+    if(errno != EEXIST)
+        return false;
+
+    // a link cannot replace an existing file: link it beside and rename it over
+    auto temporary = temporary_name(p);
+    if(linkat(f.fd(), "", AT_FDCWD, temporary.c_str(), AT_EMPTY_PATH) != 0
+            && linkat(AT_FDCWD, source.c_str(), AT_FDCWD, temporary.c_str(), AT_SYMLINK_FOLLOW) != 0)
+        return false;
+    if(rename(temporary.c_str(), p.c_str()) != 0) {
+        auto err = errno;
+        unlink(temporary.c_str());
+        errno = err;
+        return false;
+    }
+    return true;
+}
+
+bool inherit_attributes(const File& f, const Path& p)
+{
+    struct stat st;
+    if(stat(p.c_str(), &st) != 0)
+        return errno == ENOENT;
+    // the owner first, since changing it may clear the set-user-ID and set-group-ID bits;
+    // a process that cannot give away the file may still be able to keep its group
+    if(fchown(f.fd(), st.st_uid, st.st_gid) != 0) {
+        auto ret = fchown(f.fd(), static_cast<uid_t>(-1), st.st_gid);
+        (void) ret;
+    }
+    return fchmod(f.fd(), st.st_mode & 07777) == 0;
+}
+
+std::string last_error()
+{
+    return std::strerror(errno);
+}
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
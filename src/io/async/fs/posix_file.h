@@ -0,0 +1,163 @@
+#ifndef CYNNYPP_FS_POSIX_FILE_H
+#define CYNNYPP_FS_POSIX_FILE_H
+
+#include "fs_manager_interface.h"
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+/**
+ * @brief The File class owns a POSIX file descriptor and performs byte I/O on it
+ * with plain system calls (open, pread, pwrite, fstat), without any stream or locale in between.
+ *
+ * Functions report failures through their return value and errno, so that callers can build
+ * the ErrorCode that suits the operation they are performing.
+ */
+class File {
+public:
+    File() : fd_{-1} {}
+
+    /**
+     * @brief Open the file p with the given open(2) flags; O_CLOEXEC is always added.
+     * Use File::is_open to know whether the open succeeded.
+     */
+    File(const Path& p, int flags, mode_t mode = 0666);
+
+    File(const File&) = delete;
+    File& operator=(const File&) = delete;
+    File(File&& other) noexcept : fd_{other.fd_} { other.fd_ = -1; }
+    File& operator=(File&& other) noexcept;
+    ~File() { close(); }
+
+    bool is_open() const { return fd_ >= 0; }
+    explicit operator bool() const { return is_open(); }
+    int fd() const { return fd_; }
+
+    /**
+     * @brief size returns the size of the file, as reported by fstat, or -1 on failure.
+     */
+    off_t size() const;
+
+    /**
+     * @brief read_at reads up to len bytes at offset off, going on after short reads.
+     * @return the number of bytes read, which is less than len only at the end of the file, or -1 on failure
+     */
+    ssize_t read_at(void* data, size_t len, off_t off) const;
+
+    /**
+     * @brief write_at writes len bytes at offset off.
+     * @return true on success
+     */
+    bool write_at(const void* data, size_t len, off_t off);
+
+    /**
+     * @brief write writes len bytes at the current position, i.e. at the end of the file if it was opened with O_APPEND.
+     * @return true on success
+     */
+    bool write(const void* data, size_t len);
+
+    /**
+     * @brief writev writes the buffers described by iov at the current position with a single system call,
+     * going on after short writes; the array is modified while the write proceeds.
+     * @return the number of bytes written, which is less than the total length of the buffers only on failure
+     */
+    size_t writev(struct iovec* iov, int iovcnt);
+
+    /**
+     * @brief writev_at is the same as writev, but it writes at offset off, regardless of the current position.
+     */
+    size_t writev_at(struct iovec* iov, int iovcnt, off_t off);
+
+    /**
+     * @brief readv_at fills the buffers described by iov, in order, with the bytes at offset off, going on
+     * after short reads; the array is modified while the read proceeds.
+     * @return the number of bytes read, which is less than the total length of the buffers only at the end of the file,
+     * or -1 on failure
+     */
+    ssize_t readv_at(struct iovec* iov, int iovcnt, off_t off) const;
+
+    /**
+     * @brief truncate sets the size of the file.
+     * @return true on success
+     */
+    bool truncate(off_t size);
+
+    /**
+     * @brief sync_data flushes the content of the file to stable storage (fdatasync), along with
+     * the metadata needed to read it back, such as its size.
+     * @return true on success
+     */
+    bool sync_data();
+
+    /**
+     * @brief sync flushes the content and all the metadata of the file to stable storage (fsync);
+     * on a directory opened read-only, it makes its entries durable.
+     * @return true on success
+     */
+    bool sync();
+
+    void close();
+
+private:
+    int fd_;
+};
+
+/**
+ * @brief The KernelCopy enum is the outcome of copy_in_kernel.
+ */
+enum class KernelCopy {
+    done, unsupported, failed
+};
+
+/**
+ * @brief copy_in_kernel copies the first size bytes of in to the beginning of out (which must be empty)
+ * without moving them through user space: it first tries to share the extents of in with a reflink (FICLONE),
+ * which is instantaneous on copy-on-write filesystems, and then falls back to copy_file_range.
+ * @return KernelCopy::unsupported if neither is supported for these files, in which case nothing has been copied
+ * and the caller may copy them in user space; KernelCopy::failed, with errno set, on any other failure
+ */
+KernelCopy copy_in_kernel(const File& in, File& out, off_t size);
+
+/**
+ * @brief temporary_name returns a name for a temporary file beside p, which is not used by any other
+ * temporary file of this process.
+ */
+Path temporary_name(const Path& p);
+
+/**
+ * @brief open_unnamed opens for writing a new regular file without a name (O_TMPFILE) in the directory dir,
+ * which can be given one with link_unnamed once it is complete.
+ * @return the file, which is not open on failure or if the kernel or the filesystem do not support unnamed files
+ */
+File open_unnamed(const Path& dir);
+
+/**
+ * @brief link_unnamed gives the name p to a file opened with open_unnamed, atomically replacing any file
+ * already called p: the file can be seen under that name only with all the content written before.
+ * @return true on success
+ */
+bool link_unnamed(const File& f, const Path& p);
+
+/**
+ * @brief inherit_attributes gives f the permissions and, as far as the process is allowed to, the owner and group
+ * of the file p, so that f can replace p (see link_unnamed) without changing who can access it.
+ * @return true on success or if p does not exist; false, with errno set, if the permissions cannot be set
+ */
+bool inherit_attributes(const File& f, const Path& p);
+
+/**
+ * @brief last_error returns the description of errno, to be appended to the messages of the ErrorCodes.
+ */
+std::string last_error();
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_POSIX_FILE_H
@@ -0,0 +1,127 @@
+#include "trace.h"
+#include <atomic>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+
+namespace {
+
+// checked before taking the observer, so that operations do not pay for tracing when it is off
+std::atomic_bool tracing{false};
+std::shared_ptr<TraceObserver> observer_;
+std::atomic<uint64_t> last_id{0};
+
+void write_escaped(std::ostream& out, const std::string& s)
+{
+    static const char hex[] = "0123456789abcdef";
+    for(unsigned char c : s) {
+        if(c == '"' || c == '\\')
+            out << '\\' << c;
+        else if(c < 0x20)
+            out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+        else
+            out << c;
+    }
+}
+
+}
+
+void set_trace_observer(std::shared_ptr<TraceObserver> observer)
+{
+    bool on = bool(observer);
+    std::atomic_store(&observer_, std::move(observer));
+    tracing = on;
+}
+
+std::shared_ptr<TraceObserver> trace_observer()
+{
+    if(!tracing.load(std::memory_order_relaxed))
+        return nullptr;
+    return std::atomic_load(&observer_);
+}
+
+uint64_t next_trace_id()
+{
+    return ++last_id;
+}
+
+
+ChromeTraceSink::ChromeTraceSink(const Path& p)
+    : out(p, std::ios::out | std::ios::trunc)
+    , epoch(std::chrono::steady_clock::now())
+    , first(true)
+{
+    if(!out)
+        throw ErrorCode(ErrorCode::open_failure, "ChromeTraceSink was not able to create the file " + p);
+    out << "[";
+}
+
+ChromeTraceSink::~ChromeTraceSink()
+{
+    out << "\n]\n";
+}
+
+void ChromeTraceSink::on_event(const TraceEvent& e)
+{
+    auto ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+
+    std::lock_guard<std::mutex> lock(m);
+    auto tid = threads.emplace(std::this_thread::get_id(), threads.size() + 1).first->second;
+
+    uint64_t root = e.id;
+    if(e.phase == TracePhase::enqueue) {
+        if(e.parent) {
+            auto it = roots.find(e.parent);
+            root = it != roots.end() ? it->second : e.parent;
+        }
+        roots[e.id] = root;
+    }
+    else {
+        auto it = roots.find(e.id);
+        if(it != roots.end())
+            root = it->second;
+        if(e.phase == TracePhase::complete && it != roots.end())
+            roots.erase(it);
+    }
+
+    // the time spent by the worker is written as a single slice when it ends, since the io_uring workers
+    // perform many operations at once and their slices would not nest
+    if(e.phase == TracePhase::start) {
+        started[e.id] = std::make_pair(ts, tid);
+        return;
+    }
+    if(e.phase == TracePhase::end) {
+        auto it = started.find(e.id);
+        if(it == started.end())
+            return;
+        write_event(e, "X", it->second.first, it->second.second, 0);
+        out << ",\"dur\":" << ts - it->second.first << "}";
+        started.erase(it);
+        return;
+    }
+    write_event(e, e.phase == TracePhase::enqueue ? "b" : "e", ts, tid, root);
+    out << "}";
+}
+
+void ChromeTraceSink::write_event(const TraceEvent& e, const char* ph, int64_t ts, unsigned tid, uint64_t root)
+{
+    out << (first ? "\n" : ",\n");
+    first = false;
+    out << "{\"name\":\"" << e.name << "\",\"cat\":\"fs\",\"ph\":\"" << ph << "\",\"ts\":" << ts << ",\"pid\":1,\"tid\":" << tid;
+    if(root)
+        out << ",\"id\":" << root;
+    out << ",\"args\":{\"id\":" << e.id << ",\"parent\":" << e.parent << ",\"path\":\"";
+    write_escaped(out, e.path);
+    out << "\"}";
+}
+
+void ChromeTraceSink::flush()
+{
+    std::lock_guard<std::mutex> lock(m);
+    out.flush();
+}
+
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
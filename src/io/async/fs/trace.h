@@ -0,0 +1,153 @@
+#ifndef CYNNYPP_FS_TRACE_H
+#define CYNNYPP_FS_TRACE_H
+
+#include "fs_manager_interface.h"
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+
+/**
+ * @brief The TracePhase enum lists the moments of an operation reported to a TraceObserver:
+ *
+ * - enqueue: the operation has been submitted (or the object performing it, e.g. a transaction, has been created);
+ * - start: a worker thread has started performing it;
+ * - end: the worker thread has finished, and the outcome is on its way to the handler;
+ * - complete: the completion handler is about to be invoked (or the object has been destroyed).
+ *
+ * The operations that are not performed by a worker (transactions, streams, swaps) only report enqueue and complete.
+ */
+enum class TracePhase {
+    enqueue, start, end, complete
+};
+
+/**
+ * @brief The TraceEvent struct describes a moment of an operation; it is valid only during the call to the observer.
+ */
+struct TraceEvent {
+    // identifies the operation: all the events of an operation share it
+    uint64_t id;
+    // the operation on whose behalf this one is performed, e.g. the transaction of a swap or the stream
+    // of a chunk read (0 if none): the ids link the operations of a transaction in a tree
+    uint64_t parent;
+    // what the operation is, e.g. "async_read", "swap" or "transaction"
+    const char* name;
+    TracePhase phase;
+    // the path of the operation, possibly empty
+    const Path& path;
+};
+
+/**
+ * @brief The TraceObserver class is notified of the events of the operations performed by FilesystemManager,
+ * ChunkedFstream and SwappingBuffer, once installed with set_trace_observer.
+ *
+ * on_event is invoked by the threads of the io_service and by the worker threads, also concurrently,
+ * while they perform the operations: it must be thread-safe, and it should be quick.
+ */
+class TraceObserver {
+public:
+    virtual ~TraceObserver() = default;
+    virtual void on_event(const TraceEvent& e) = 0;
+};
+
+/**
+ * @brief set_trace_observer installs the observer of all the operations of the process, replacing the former one;
+ * an empty pointer turns tracing off. Only the operations submitted afterwards are traced.
+ */
+void set_trace_observer(std::shared_ptr<TraceObserver> observer);
+
+/**
+ * @brief trace_observer returns the observer installed, or an empty pointer if tracing is off, which is cheap to check.
+ */
+std::shared_ptr<TraceObserver> trace_observer();
+
+/**
+ * @brief next_trace_id returns a new id for a traced operation (never 0).
+ */
+uint64_t next_trace_id();
+
+/**
+ * @brief The TraceScope class makes an operation the parent of those submitted by the current thread while it is alive;
+ * scopes can be nested, the innermost one wins.
+ */
+class TraceScope {
+public:
+    explicit TraceScope(uint64_t parent) : previous{current_()} { current_() = parent; }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+    ~TraceScope() { current_() = previous; }
+
+    /**
+     * @brief current returns the parent set by the innermost scope of the current thread, 0 if none.
+     */
+    static uint64_t current() { return current_(); }
+
+private:
+    static uint64_t& current_() { static thread_local uint64_t id = 0; return id; }
+
+    uint64_t previous;
+};
+
+/**
+ * @brief trace reports an event to the observer installed, if any.
+ */
+inline void trace(uint64_t id, uint64_t parent, const char* name, TracePhase phase, const Path& path = {})
+{
+    if(auto observer = trace_observer())
+        observer->on_event(TraceEvent{id, parent, name, phase, path});
+}
+
+/**
+ * @brief The ChromeTraceSink class is a TraceObserver that writes the events to a file in the trace event format
+ * of Chrome (a JSON array), which can be loaded in chrome://tracing or Perfetto.
+ *
+ * Each operation is an asynchronous slice, from enqueue to complete, on the track of the outermost operation
+ * it belongs to (e.g. its transaction), so that all the I/O of a transaction is seen on a single timeline; the time spent
+ * by a worker performing it, from start to end, is also a slice on the thread of the worker.
+ */
+class ChromeTraceSink : public TraceObserver {
+public:
+    /**
+     * \throws ErrorCode::open_failure if the file cannot be created
+     */
+    explicit ChromeTraceSink(const Path& p);
+    ChromeTraceSink(const ChromeTraceSink&) = delete;
+    ChromeTraceSink& operator=(const ChromeTraceSink&) = delete;
+    // terminates the array
+    ~ChromeTraceSink();
+
+    void on_event(const TraceEvent& e) override;
+
+    /**
+     * @brief flush writes the events received so far to the file.
+     */
+    void flush();
+
+private:
+    std::mutex m;
+    std::ofstream out;
+    const std::chrono::steady_clock::time_point epoch;
+    bool first;
+    // the outermost operation of each operation in progress
+    std::map<uint64_t, uint64_t> roots;
+    // small numbers for the threads, easier to read than their ids
+    std::map<std::thread::id, unsigned> threads;
+    // when and on which thread the operations in progress have been started by a worker
+    std::map<uint64_t, std::pair<int64_t, unsigned>> started;
+
+    // writes the common fields of an event, leaving the object open
+    void write_event(const TraceEvent& e, const char* ph, int64_t ts, unsigned tid, uint64_t root);
+};
+
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_FS_TRACE_H
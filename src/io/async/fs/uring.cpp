@@ -0,0 +1,118 @@
+#include "uring.h"
+
+#ifdef CYNNYPP_HAS_IO_URING
+
+#include "fs_manager_interface.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+Uring::Uring(unsigned entries)
+    : fd(-1)
+    , sq_ring(MAP_FAILED)
+    , cq_ring(MAP_FAILED)
+    , sqes(static_cast<io_uring_sqe*>(MAP_FAILED))
+    , sqe_head(0)
+    , sqe_tail(0)
+{
+    io_uring_params p;
+    std::memset(&p, 0, sizeof(p));
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if(fd < 0)
+        throw ErrorCode(ErrorCode::internal_failure, std::string{"io_uring_setup failed: "} + std::strerror(errno));
+
+    sq_size = p.sq_entries;
+    cq_size = p.cq_entries;
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    // with IORING_FEAT_SINGLE_MMAP both the rings live in the same mapping
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap)
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(sq_ring != MAP_FAILED)
+        cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if(cq_ring != MAP_FAILED)
+        sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sq_size * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+    if(sqes == MAP_FAILED) {
+        std::string msg{std::string{"io_uring mmap failed: "} + std::strerror(errno)};
+        release();
+        throw ErrorCode(ErrorCode::internal_failure, msg);
+    }
+
+    auto sq = static_cast<uint8_t*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+    auto cq = static_cast<uint8_t*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+}
+
+Uring::~Uring()
+{
+    release();
+}
+
+void Uring::release()
+{
+    if(sqes != MAP_FAILED)
+        munmap(sqes, sq_size * sizeof(io_uring_sqe));
+    if(cq_ring != MAP_FAILED && cq_ring != sq_ring)
+        munmap(cq_ring, cq_ring_size);
+    if(sq_ring != MAP_FAILED)
+        munmap(sq_ring, sq_ring_size);
+    if(fd >= 0)
+        close(fd);
+}
+
+io_uring_sqe* Uring::get_sqe()
+{
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if(sqe_tail - head >= sq_size)
+        return nullptr;
+    io_uring_sqe* sqe = &sqes[sqe_tail & sq_mask];
+    ++sqe_tail;
+    std::memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int Uring::submit(unsigned wait_nr)
+{
+    // publish the entries prepared since the last submission
+    unsigned tail = *sq_tail;
+    for(; sqe_head != sqe_tail; ++sqe_head, ++tail)
+        sq_array[tail & sq_mask] = sqe_head & sq_mask;
+    __atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+
+    unsigned to_submit = tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    unsigned flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+    if(!to_submit && !wait_nr)
+        return 0;
+
+    int ret;
+    do {
+        ret = static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags, nullptr, 0));
+    } while(ret < 0 && errno == EINTR);
+    return ret < 0 ? -errno : ret;
+}
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_HAS_IO_URING
@@ -0,0 +1,108 @@
+#ifndef CYNNYPP_FS_URING_H
+#define CYNNYPP_FS_URING_H
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define CYNNYPP_HAS_IO_URING 1
+#endif
+#endif
+
+#ifdef CYNNYPP_HAS_IO_URING
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+namespace cynny {
+namespace cynnypp {
+namespace filesystem {
+namespace impl {
+
+/**
+ * @brief The Uring class is a minimal wrapper around a Linux io_uring instance,
+ * set up and driven directly through the io_uring_setup/io_uring_enter system calls.
+ *
+ * The ring is meant to be used by a single thread: submission queue entries are obtained with
+ * Uring::get_sqe, filled in and then handed to the kernel with Uring::submit; completions are
+ * consumed with Uring::for_each_cqe.
+ */
+class Uring {
+public:
+    /**
+     * @brief Create a ring with (at least) the given number of submission queue entries.
+     * @throws ErrorCode::internal_failure if the kernel does not support io_uring or the ring cannot be set up
+     */
+    explicit Uring(unsigned entries);
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+    ~Uring();
+
+    /**
+     * @brief get_sqe returns a zeroed submission queue entry to be filled in by the caller.
+     * @return the entry, or nullptr if the submission queue is full
+     */
+    io_uring_sqe* get_sqe();
+
+    /**
+     * @brief submit hands the prepared entries to the kernel and, if wait_nr is not 0,
+     * blocks until at least wait_nr completions are available.
+     * @return the number of entries submitted, or -errno
+     */
+    int submit(unsigned wait_nr = 0);
+
+    /**
+     * @brief for_each_cqe invokes f(user_data, res) on all the available completions and consumes them.
+     * @return the number of completions consumed
+     */
+    template<typename F>
+    unsigned for_each_cqe(F&& f)
+    {
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        unsigned count = 0;
+        for(; head != tail; ++head, ++count) {
+            const io_uring_cqe& cqe = cqes[head & cq_mask];
+            f(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    unsigned sq_entries() const { return sq_size; }
+    unsigned cq_entries() const { return cq_size; }
+
+private:
+    // unmap the rings and close the ring descriptor
+    void release();
+
+    int fd;
+    unsigned sq_size;
+    unsigned cq_size;
+
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    io_uring_sqe* sqes;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    unsigned sqe_head;
+    unsigned sqe_tail;
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+};
+
+} // namespace impl
+} // namespace filesystem
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNYPP_HAS_IO_URING
+
+#endif // CYNNYPP_FS_URING_H
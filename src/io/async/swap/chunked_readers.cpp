@@ -89,6 +89,7 @@ void SwappingBufferAppendChunkedReader::next_chunk(filesystem::FilesystemManager
             if(ec == filesystem::ErrorCode::end_of_file || ec == filesystem::ErrorCode::stopped) {
                 file_finished = true;
                 //the file has finished: start reading from the swapping one.
+                filesystem::TraceScope scope{info->data->traceId()};
                 tmp_file = fs.make_chunked_stream(tmp_path, chunk_size); //raw because we're reading from a swapping append buffer, hence there's no version on it.
                 if(data.size() > 0) {
                     h(filesystem::ErrorCode::success, data);
@@ -32,9 +32,18 @@ SwappingBuffer::SwappingBuffer(boost::asio::io_service& io, filesystem::Filesyst
     swappingBuffer = &bufB;
     //get actual size from filesystem?
     realSize = 0;
-
+    if(filesystem::trace_observer()) {
+        trace_id = filesystem::next_trace_id();
+        trace_parent = filesystem::TraceScope::current();
+        filesystem::trace(trace_id, trace_parent, "transaction", filesystem::TracePhase::enqueue, tmp_path);
+    }
 } //for now it does nothing; later it will initilize the vectors properly!
 
+SwappingBuffer::~SwappingBuffer() {
+    if(trace_id)
+        filesystem::trace(trace_id, trace_parent, "transaction", filesystem::TracePhase::complete, tmp_path);
+}
+
 
 void SwappingBuffer::size(std::function<void(uint32_t)> successCallback) noexcept {
     enqueueAndRun([this, successCallback]() {
@@ -94,9 +103,22 @@ void SwappingBuffer::startSwapping(std::function<void()> successCallback, std::f
     currentBuffer->clear();
     //initialize collections.
     swapping = true;
+    if(trace_id) {
+        swap_trace_id = filesystem::next_trace_id();
+        filesystem::trace(swap_trace_id, trace_id, "swap", filesystem::TracePhase::enqueue, tmp_path);
+    }
+    //the write of the swap is traced as part of it
+    filesystem::TraceScope scope{swap_trace_id ? swap_trace_id : filesystem::TraceScope::current()};
     swappingOperation(successCallback, errorCallback);
 }
 
+void SwappingBuffer::traceSwapEnd() {
+    if(swap_trace_id) {
+        filesystem::trace(swap_trace_id, trace_id, "swap", filesystem::TracePhase::complete, tmp_path);
+        swap_trace_id = 0;
+    }
+}
+
 void SwappingBuffer::performPendingOperations() {
     boost::asio::io_service::strand s(io); //the strand is used to be sure across implementations that the functions will be executed in order.
     auto iterator = callbacks.begin();
@@ -108,6 +130,15 @@ void SwappingBuffer::performPendingOperations() {
 }
 
 void SwappingBuffer::enqueueAndRun(std::function<void()> afterSwapCompletedCallback)  {
+    if(trace_id) {
+        //the operations submitted by the callback are performed on behalf of the transaction
+        auto id = trace_id;
+        auto callback = std::move(afterSwapCompletedCallback);
+        afterSwapCompletedCallback = [id, callback]() {
+            filesystem::TraceScope scope{id};
+            callback();
+        };
+    }
     callbacks.push_back(std::move(afterSwapCompletedCallback));
     if(!swapping) performPendingOperations();
 }
@@ -118,6 +149,7 @@ void SwappingBuffer::
 //management of the routine to be performed after the append operation, in practice.
 void SwappingBuffer::postSwapRoutine(const filesystem::ErrorCode &ec, const size_t length, std::function<void()> successCallback, std::function<void(const filesystem::ErrorCode&)> errorCallback) {
     swapping = false;
+    filesystem::TraceScope scope{swap_trace_id ? swap_trace_id : filesystem::TraceScope::current()};
     if(isFirstSwappingAttempt && (ec == filesystem::ErrorCode::invalid_argument || ec == filesystem::ErrorCode::open_failure)) {
         //maybe the directory is not available?
         isFirstSwappingAttempt = false;
@@ -130,11 +162,14 @@ void SwappingBuffer::postSwapRoutine(const filesystem::ErrorCode &ec, const size
             return;
         } catch (const filesystem::ErrorCode &createDirEc) {
 //            ServiceLocator::setStatus(Status{0, 0, 1, 0});
+            traceSwapEnd();
             error = true;
             errorCallback({filesystem::ErrorCode::write_failure, std::string("Uknown error while swapping buffer to disk.")+ec.what()});
             return;
         }
-    } else if (!ec) {
+    }
+    traceSwapEnd();
+    if (!ec) {
         isOnDisk = true;
         successCallback();
         performPendingOperations();
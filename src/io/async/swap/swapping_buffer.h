@@ -8,6 +8,7 @@
 
 
 #include "../fs/fs_manager_interface.h"
+#include "../fs/trace.h"
 #include <list>
 #include <vector>
 #include <cstdint>
@@ -78,7 +79,12 @@ public:
      */
     static constexpr size_t maxBufferSize = MAX_OCCUPIED_MEMORY;
 
-    virtual ~SwappingBuffer() = default;
+    /** The id under which the transaction and the operations performed on its behalf (swaps, reads, saves) are traced;
+     * 0 if no trace observer was installed when the buffer was created (see filesystem::set_trace_observer).
+     */
+    uint64_t traceId() const { return trace_id; }
+
+    virtual ~SwappingBuffer();
 
 protected:
     SwappingBuffer(boost::asio::io_service& io, filesystem::FilesystemManagerInterface& fs, const std::string& root_dir);
@@ -150,6 +156,15 @@ private:
 
     static uint64_t currentTransactionId;
 
+    uint64_t trace_id = 0;
+    uint64_t trace_parent = 0;
+    // the swap in progress, if traced
+    uint64_t swap_trace_id = 0;
+
+    /** Reports the end of the swap in progress to the trace observer, if traced
+     */
+    void traceSwapEnd();
+
 };
 
 
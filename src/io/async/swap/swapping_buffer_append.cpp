@@ -80,9 +80,13 @@ void SwappingBufferAppend::saveAllContents(const std::string &destinationPath, s
 
 void SwappingBufferAppend::swappingOperation(std::function<void()> successCallback, std::function<void(const filesystem::ErrorCode&)> errorCallback) {
     auto self = this->shared_from_this();
+    // swaps are background work: they must not delay the reads serving the users,
+    // nor fill the page cache with data that is read back only when the buffer is saved
+    filesystem::SubmitOptions opts{filesystem::Priority::bulk};
+    opts.direct_io = true;
     self->fs.async_append(tmp_path, *swappingBuffer, [self, successCallback, errorCallback](const filesystem::ErrorCode& ec, size_t length) {
         self->postSwapRoutine(ec, length, successCallback, errorCallback);
-    });
+    }, opts);
 
 }
 
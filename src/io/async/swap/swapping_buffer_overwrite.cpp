@@ -68,15 +68,18 @@ void SwappingBufferOverwrite::startSwapping(std::function<void()> successCallbac
 
 
 void SwappingBufferOverwrite::swappingOperation(std::function<void()> successCallback, std::function<void(const filesystem::ErrorCode&)> errorCallback) {
+    // swaps bypass the page cache, as in SwappingBufferAppend
+    filesystem::SubmitOptions opts{filesystem::Priority::bulk};
+    opts.direct_io = true;
     if(!isOnDisk) { //first call, allocatee first 8 bytes to save version
         fs.async_write(tmp_path, *swappingBuffer, [this, successCallback, errorCallback](const filesystem::ErrorCode& ec, size_t length){
             this->postSwapRoutine(ec, length, successCallback, errorCallback);
-        });
+        }, opts);
         return;
     }
     fs.async_append(tmp_path, *swappingBuffer, [this, successCallback, errorCallback](const filesystem::ErrorCode& ec, size_t length){
         this->postSwapRoutine(ec, length, successCallback, errorCallback);
-    });
+    }, opts);
     return;
 }
 
@@ -0,0 +1,135 @@
+#ifndef CYNNY_MPSC_QUEUE_H
+#define CYNNY_MPSC_QUEUE_H
+
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+
+namespace cynny {
+namespace cynnypp {
+namespace utilities {
+
+/**
+ * @brief The MpscNode struct is the hook that must be inherited by the elements of an MpscQueue.
+ */
+struct MpscNode {
+    MpscNode() : next{nullptr} {}
+    MpscNode(const MpscNode&) = delete;
+    MpscNode& operator=(const MpscNode&) = delete;
+    virtual ~MpscNode() = default;
+
+    std::atomic<MpscNode*> next;
+};
+
+/**
+ * @brief Offers a lock-free, unbounded, intrusive queue with multiple producers and a single consumer.
+ *
+ * Any thread can MpscQueue::push elements, while only one thread at a time can MpscQueue::pop them.
+ * A push costs a single atomic exchange and never blocks; a pop never blocks as well.
+ *
+ * The queue owns the elements it contains: they are pushed and popped as std::unique_ptr,
+ * and the ones still inside the queue are destroyed with it.
+ *
+ * Since a push is completed in two steps (the exchange on the head and the link to the previous element),
+ * a pop racing with a push may not see the element being pushed and return an empty pointer:
+ * producers are expected to notify the consumer *after* the push returned, so that the consumer
+ * will retry.
+ */
+template<typename T>
+class MpscQueue {
+    static_assert(std::is_base_of<MpscNode, T>::value, "MpscQueue elements must inherit from MpscNode");
+public:
+    MpscQueue()
+        : head{&stub}
+        , tail{&stub}
+    {}
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    ~MpscQueue()
+    {
+        while(pop()) {}
+    }
+
+    /**
+     * @brief push appends an element to the queue; it can be invoked by any thread.
+     * @param elem the element to be enqueued
+     */
+    void push(std::unique_ptr<T> elem)
+    {
+        push_node(elem.release());
+    }
+
+    /**
+     * @brief push appends the elements to the queue, in order, with a single atomic exchange;
+     * it can be invoked by any thread, and the elements of other producers are not interleaved with them.
+     * @param elems the elements to be enqueued
+     */
+    void push(std::vector<std::unique_ptr<T>> elems)
+    {
+        if(elems.empty())
+            return;
+        // link the elements among themselves first: they become visible to the consumer all together
+        for(size_t i = 0; i + 1 < elems.size(); ++i)
+            elems[i]->next.store(elems[i + 1].get(), std::memory_order_relaxed);
+        MpscNode* first = elems.front().get();
+        MpscNode* last = elems.back().get();
+        for(auto& e : elems)
+            e.release();
+        last->next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* prev = head.exchange(last, std::memory_order_acq_rel);
+        prev->next.store(first, std::memory_order_release);
+    }
+
+    /**
+     * @brief pop removes the element at the front of the queue; only the consumer thread can invoke it.
+     * @return the element at the front of the queue, or an empty pointer if the queue is empty
+     */
+    std::unique_ptr<T> pop()
+    {
+        MpscNode* t = tail;
+        MpscNode* next = t->next.load(std::memory_order_acquire);
+        if(t == &stub) {
+            if(!next)
+                return nullptr;
+            tail = next;
+            t = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if(next) {
+            tail = next;
+            return std::unique_ptr<T>(static_cast<T*>(t));
+        }
+        // t is the last element: if a producer is in the middle of a push, give up
+        if(t != head.load(std::memory_order_acquire))
+            return nullptr;
+        // otherwise put back the stub, so that t can be detached
+        push_node(&stub);
+        next = t->next.load(std::memory_order_acquire);
+        if(next) {
+            tail = next;
+            return std::unique_ptr<T>(static_cast<T*>(t));
+        }
+        return nullptr;
+    }
+
+private:
+    void push_node(MpscNode* n)
+    {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        MpscNode* prev = head.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    std::atomic<MpscNode*> head;
+    MpscNode* tail;
+    MpscNode stub;
+};
+
+} // namespace utilities
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNY_MPSC_QUEUE_H
@@ -0,0 +1,140 @@
+#ifndef CYNNY_WAKEUP_H
+#define CYNNY_WAKEUP_H
+
+#include <atomic>
+#include <cstdint>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <condition_variable>
+#include <mutex>
+#endif
+
+
+namespace cynny {
+namespace cynnypp {
+namespace utilities {
+
+/**
+ * @brief Offers a way for any number of producers to wake up a single consumer thread waiting for work,
+ * e.g. a worker waiting for its queue to be filled.
+ *
+ * The producers publish the work first, then call Wakeup::notify. The consumer looks for work and,
+ * when there is none, calls Wakeup::wait, which returns as soon as a notification arrives. A notification
+ * arrived at any time since the consumer last returned from Wakeup::wait makes it return at once,
+ * so none can be lost between looking for work and going to sleep.
+ *
+ * While the consumer is running, the first notification marks it as notified and the following ones
+ * cost just a fence and a load: a notification takes no lock, and makes a system call only when the
+ * consumer is asleep. On Linux the consumer sleeps on a futex, elsewhere on a condition variable.
+ *
+ * A consumer that sleeps somewhere else, e.g. polling an eventfd along with other descriptors,
+ * calls Wakeup::prepare_wait and Wakeup::finish_wait around its own sleep, while its producers call
+ * Wakeup::signal and wake it up by their own means when it returns true.
+ */
+class Wakeup {
+public:
+    Wakeup() : state{running} {}
+    Wakeup(const Wakeup&) = delete;
+    Wakeup& operator=(const Wakeup&) = delete;
+
+    /**
+     * @brief notify wakes up the consumer, or makes its next wait return at once; it can be invoked by any thread.
+     */
+    void notify()
+    {
+        if(signal())
+            wake();
+    }
+
+    /**
+     * @brief signal marks the consumer as notified, without waking it up; it can be invoked by any thread.
+     * @return true if the consumer is asleep (or about to sleep) and has to be woken up
+     */
+    bool signal()
+    {
+        // order the publication of the work before the look at the state: if the consumer has not
+        // consumed the notification yet, it will see the work after consuming it
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(state.load(std::memory_order_relaxed) == notified)
+            return false;
+        return state.exchange(notified) == sleeping;
+    }
+
+    /**
+     * @brief wait blocks the consumer until it is notified; only the consumer thread can invoke it.
+     */
+    void wait()
+    {
+        if(!prepare_wait())
+            return;
+#ifdef __linux__
+        while(true) {
+            syscall(SYS_futex, reinterpret_cast<int32_t*>(&state), FUTEX_WAIT_PRIVATE, sleeping, nullptr, nullptr, 0);
+            auto expected = notified;
+            if(state.compare_exchange_strong(expected, running))
+                break;
+        }
+#else
+        std::unique_lock<std::mutex> lock{mtx};
+        cv.wait(lock, [this]() { return state.load() == notified; });
+        state = running;
+#endif
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    /**
+     * @brief prepare_wait announces that the consumer is going to sleep; only the consumer thread can invoke it.
+     * @return false if the consumer has been notified meanwhile and must look for work instead of sleeping
+     */
+    bool prepare_wait()
+    {
+        // running becomes sleeping, notified becomes running
+        static_assert(notified - 1 == running && running - 1 == sleeping, "the states must be consecutive");
+        if(state.fetch_sub(1) == notified) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @brief finish_wait tells that the consumer has woken up after prepare_wait returned true,
+     * consuming any notification; only the consumer thread can invoke it.
+     */
+    void finish_wait()
+    {
+        state.exchange(running);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+private:
+    void wake()
+    {
+#ifdef __linux__
+        syscall(SYS_futex, reinterpret_cast<int32_t*>(&state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#else
+        std::lock_guard<std::mutex> lock{mtx};
+        cv.notify_one();
+#endif
+    }
+
+    static constexpr int32_t sleeping = -1;
+    static constexpr int32_t running = 0;
+    static constexpr int32_t notified = 1;
+
+    static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t), "the futex is the state itself");
+    std::atomic<int32_t> state;
+#ifndef __linux__
+    std::mutex mtx;
+    std::condition_variable cv;
+#endif
+};
+
+} // namespace utilities
+} // namespace cynnypp
+} // namespace cynny
+
+#endif // CYNNY_WAKEUP_H
@@ -1,6 +1,10 @@
 #include <iostream>
+#include <chrono>
+#include <ctime>
+#include <thread>
 #include <boost/filesystem/operations.hpp>
 #include <io/async/fs/fs_manager.h>
+#include "fs_backend.h"
 #include "catch.hpp"
 
 
@@ -9,7 +13,7 @@ const std::string input_dir = "../test/file_system/data";
 boost::asio::io_service::work *w;
 boost::asio::io_service io_;
 boost::asio::deadline_timer *t = nullptr;
-FilesystemManager fs(io_);
+FilesystemManager fs(io_, 1, test_backend());
 
 inline void createKeepAlive() {
     w = new boost::asio::io_service::work(io_);
@@ -142,3 +146,35 @@ SCENARIO("Never calling the nextChunk function", "[fs][fs_chunked]"){
     io.reset();
     io.run(); //should just exit withour issues.
 }
+
+
+SCENARIO("Reading a chunk into a buffer not consumed yet", "[fs][fs_chunked]"){
+    auto reader = std::make_shared<impl::ChunkedReader>(fs, input_dir+"/read/multiplea", 1024);
+    impl::HotDoubleBuffer db(1024);
+    auto buf = db.get_and_swap();
+    buf.set_hot(true);
+    ErrorCode read_ec{ErrorCode::unknown_error};
+    bool read_done = false;
+    io_.reset();
+    auto cpu = std::clock();
+    fs.async_read_chunk(reader, 0, buf, [&](const ErrorCode& ec, size_t) { read_ec = ec; read_done = true; });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    io_.poll();
+
+    // the read waits for the buffer without keeping the worker busy
+    REQUIRE_FALSE(read_done);
+    REQUIRE(std::clock() - cpu < CLOCKS_PER_SEC / 20);
+
+    // any operation wakes up the worker, which then finds the buffer consumed
+    buf.set_hot(false);
+    Buffer other;
+    bool other_done = false;
+    fs.async_read(input_dir+"/read/multiplea", other, [&](const ErrorCode&, size_t) { other_done = true; });
+    while(!read_done || !other_done) {
+        io_.reset();
+        io_.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(read_ec == ErrorCode::end_of_file);
+    REQUIRE(Buffer(buf) == other);
+}
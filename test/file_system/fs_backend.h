@@ -0,0 +1,19 @@
+#ifndef CYNNYPP_TEST_FS_BACKEND_H
+#define CYNNYPP_TEST_FS_BACKEND_H
+
+#include <cstdlib>
+#include <string>
+#include "io/async/fs/fs_manager.h"
+
+/**
+ * @brief test_backend returns the FilesystemManager backend the asynchronous suites have to be run on,
+ * as selected by the CYNNYPP_FS_BACKEND environment variable ("threads" by default, or "io_uring").
+ */
+inline cynny::cynnypp::filesystem::FilesystemManager::Backend test_backend()
+{
+    using Backend = cynny::cynnypp::filesystem::FilesystemManager::Backend;
+    const char* backend = std::getenv("CYNNYPP_FS_BACKEND");
+    return backend && std::string{backend} == "io_uring" ? Backend::io_uring : Backend::threads;
+}
+
+#endif // CYNNYPP_TEST_FS_BACKEND_H
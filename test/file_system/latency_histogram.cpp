@@ -0,0 +1,45 @@
+#include <io/async/fs/latency_histogram.h>
+#include "catch.hpp"
+
+
+using namespace cynny::cynnypp::filesystem::impl;
+
+
+TEST_CASE("LatencyHistogram", "[latency_histogram][fs]") {
+    LatencyHistogram h;
+
+    SECTION("Empty histogram") {
+        auto s = h.snapshot();
+        REQUIRE(s.count == 0);
+        REQUIRE(s.buckets.empty());
+        REQUIRE(s.percentile(0.5).count() == 0);
+        REQUIRE(s.mean().count() == 0);
+    }
+
+    SECTION("Buckets") {
+        // every duration falls within the bounds of its bucket, which grow by 1/16 at most
+        uint64_t ns = 0;
+        while(ns < (uint64_t{1} << 39)) {
+            auto i = LatencyHistogram::bucket(ns);
+            REQUIRE(i < LatencyHistogram::n_buckets);
+            REQUIRE(LatencyHistogram::upper_bound(i) >= ns);
+            REQUIRE((i == 0 || LatencyHistogram::upper_bound(i - 1) < ns));
+            REQUIRE(LatencyHistogram::upper_bound(i) - ns <= ns / 16);
+            ns = ns * 9 / 8 + 1;
+        }
+        REQUIRE(LatencyHistogram::bucket(uint64_t{1} << 50) == LatencyHistogram::n_buckets - 1);
+    }
+
+    SECTION("Percentiles") {
+        for(int i = 1; i <= 1000; ++i)
+            h.record(std::chrono::microseconds(i));
+        auto s = h.snapshot();
+        REQUIRE(s.count == 1000);
+        REQUIRE(s.max == 1000000);
+        REQUIRE(s.mean() == std::chrono::nanoseconds(500500));
+        auto median = s.percentile(0.5).count();
+        REQUIRE(median >= 500000);
+        REQUIRE(median <= 500000 + 500000 / 16);
+        REQUIRE(s.percentile(1).count() == 1000000);
+    }
+}
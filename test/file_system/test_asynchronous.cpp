@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <set>
 #include <boost/filesystem/operations.hpp>
 #include <boost/asio.hpp>
 #include "io/async/fs/fs_manager.h"
+#include "fs_backend.h"
 #include "catch.hpp"
 
 using Buffer = std::vector<uint8_t>;
@@ -10,12 +15,82 @@ using namespace cynny::cynnypp::filesystem;
 const std::string input_dir = "../test/file_system/data";
 const std::string working_dir = "./data";
 
+/*
+ * Recorder is a TraceObserver that records the events of the operations, so that the tests can check the order
+ * in which the worker handles them. It can also hold the worker at the start of the operations on a path,
+ * so that other operations are queued behind them deterministically.
+ */
+struct Recorder : TraceObserver {
+    struct Record {
+        uint64_t id;
+        uint64_t parent;
+        std::string name;
+        Path path;
+        TracePhase phase;
+    };
+
+    void on_event(const TraceEvent& e) override {
+        std::unique_lock<std::mutex> lock(m);
+        records.push_back(Record{e.id, e.parent, e.name, e.path, e.phase});
+        if(e.phase != TracePhase::start || !held.count(e.path))
+            return;
+        waiting.insert(e.path);
+        cv.notify_all();
+        // a second at most, so that a failing test does not hang
+        cv.wait_for(lock, std::chrono::seconds{1}, [&]() { return !held.count(e.path); });
+        waiting.erase(e.path);
+    }
+
+    // the worker will wait at the start of the operations on p until it is released
+    void hold(const Path& p) {
+        std::lock_guard<std::mutex> lock(m);
+        held.insert(p);
+    }
+
+    void release(const Path& p) {
+        std::lock_guard<std::mutex> lock(m);
+        held.erase(p);
+        cv.notify_all();
+    }
+
+    // waits until the worker is held at the start of an operation on p
+    bool wait_held(const Path& p) {
+        std::unique_lock<std::mutex> lock(m);
+        return cv.wait_for(lock, std::chrono::seconds{5}, [&]() { return waiting.count(p) > 0; });
+    }
+
+    bool ended(const Path& p) {
+        std::lock_guard<std::mutex> lock(m);
+        return std::any_of(records.begin(), records.end(), [&p](const Record& r) { return r.phase == TracePhase::end && r.path == p; });
+    }
+
+    // the names of the files of the operations started, in order, without their numbers: the io_uring backend
+    // keeps many transfers in flight, so it may complete them in another order
+    std::vector<std::string> started() {
+        std::lock_guard<std::mutex> lock(m);
+        std::vector<std::string> ret;
+        for(const auto& r : records) {
+            if(r.phase != TracePhase::start)
+                continue;
+            auto name = r.path.substr(working_dir.size() + 1);
+            ret.push_back(name.substr(0, name.find_first_of("0123456789")));
+        }
+        return ret;
+    }
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<Record> records;
+    std::set<Path> held;
+    std::set<Path> waiting;
+};
+
 SCENARIO("Async Read", "[fs_async_read][fs_async][fs]")  {
     boost::asio::io_service io;
     std::string s1 = "aaaaaaaaaaaaaaaaaaaa\n";
     Buffer r1;
     r1.insert(r1.begin(), s1.begin(), s1.end());
-    FilesystemManager fs(io);
+    FilesystemManager fs(io, 1, test_backend());
     Buffer output1, output2;
 
     GIVEN("A normal file") {
@@ -143,7 +218,7 @@ SCENARIO("Write asynchronously", "[fs_async_write][fs_async][fs]"){
     std::string s1 = "aaaaaaaaaaaaaaaaaaaa\n";
     Buffer r1;
     r1.insert(r1.begin(), s1.begin(), s1.end());
-    FilesystemManager fs(io);
+    FilesystemManager fs(io, 1, test_backend());
     Buffer input1, input2;
     /* copy of normal file. */
     fs.removeDirectory(working_dir);
@@ -311,3 +386,1534 @@ SCENARIO("Write asynchronously", "[fs_async_write][fs_async][fs]"){
 
 }
 
+
+
+SCENARIO("Asynchronous operations on a pool of workers", "[fs_async_workers][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager fs(io, 4, test_backend());
+    REQUIRE(fs.workers_count() == 4);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+
+    GIVEN("Several files receiving many appends each") {
+        const size_t n_files = 8;
+        const size_t n_appends = 64;
+        std::vector<Buffer> chunks;
+        for(size_t i = 0; i < n_appends; ++i)
+            chunks.push_back(Buffer(i + 1, static_cast<uint8_t>(i)));
+
+        WHEN("all the appends are submitted at once") {
+            size_t completed = 0;
+            bool failed = false;
+            std::unique_ptr<boost::asio::io_service::work> work{new boost::asio::io_service::work(io)};
+            for(size_t f = 0; f < n_files; ++f) {
+                auto path = working_dir + "/pool" + std::to_string(f);
+                for(size_t i = 0; i < n_appends; ++i) {
+                    fs.async_append(path, chunks[i], [&](const ErrorCode& ec, size_t) {
+                        failed = failed || ec;
+                        if(++completed == n_files * n_appends)
+                            work.reset();
+                    });
+                }
+            }
+            io.run();
+
+            THEN("every file contains the chunks in submission order") {
+                REQUIRE_FALSE(failed);
+                Buffer expected;
+                for(auto& c : chunks)
+                    expected.insert(expected.end(), c.begin(), c.end());
+                for(size_t f = 0; f < n_files; ++f)
+                    REQUIRE(fs.readFile(working_dir + "/pool" + std::to_string(f)) == expected);
+            }
+        }
+    }
+
+    GIVEN("A write followed by a read on the same path") {
+        auto path = working_dir + "/write_then_read";
+        Buffer in(10000, 42), out;
+        WHEN("both are submitted without waiting") {
+            ErrorCode read_ec{ErrorCode::unknown_error};
+            fs.async_write(path, in, [](const ErrorCode&, size_t) {});
+            fs.async_read(path, out, [&read_ec](const ErrorCode& ec, size_t) { read_ec = ec; });
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            io.run();
+            THEN("the read sees the written content") {
+                REQUIRE(read_ec == ErrorCode::success);
+                REQUIRE(out == in);
+            }
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Creating a FilesystemManager without workers", "[fs_async_workers][fs_async][fs]") {
+    boost::asio::io_service io;
+    REQUIRE_THROWS_AS(FilesystemManager(io, 0), std::invalid_argument);
+}
+
+SCENARIO("Asynchronous operations in direct I/O mode", "[fs_async_direct][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager fs(io, 1, test_backend());
+    SubmitOptions direct;
+    direct.direct_io = true;
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+
+    GIVEN("Buffers whose sizes are not multiple of the block size") {
+        std::vector<Buffer> chunks;
+        for(size_t size : {0, 1, 4095, 4096, 4097, 1024 * 1024 + 3}) {
+            Buffer b(size);
+            for(size_t i = 0; i < size; ++i)
+                b[i] = static_cast<uint8_t>(i * 7 + size);
+            chunks.push_back(std::move(b));
+        }
+
+        WHEN("each of them is written and read back") {
+            THEN("the content of the file matches the buffer") {
+                for(auto& c : chunks) {
+                    auto path = working_dir + "/direct" + std::to_string(c.size());
+                    Buffer out;
+                    size_t written = 0;
+                    ErrorCode read_ec{ErrorCode::unknown_error};
+                    fs.async_write(path, c, [&written](const ErrorCode&, size_t s) { written = s; }, direct);
+                    fs.async_read(path, out, [&read_ec](const ErrorCode& ec, size_t) { read_ec = ec; }, direct);
+                    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+                    io.run();
+                    io.reset();
+                    REQUIRE(written == c.size());
+                    REQUIRE(read_ec == ErrorCode::success);
+                    REQUIRE(out == c);
+                    REQUIRE(boost::filesystem::file_size(path) == c.size());
+                }
+            }
+        }
+
+        WHEN("all of them are appended to the same file") {
+            auto path = working_dir + "/direct_append";
+            size_t completed = 0;
+            bool failed = false;
+            std::unique_ptr<boost::asio::io_service::work> work{new boost::asio::io_service::work(io)};
+            for(auto& c : chunks) {
+                fs.async_append(path, c, [&](const ErrorCode& ec, size_t) {
+                    failed = failed || ec;
+                    if(++completed == chunks.size())
+                        work.reset();
+                }, direct);
+            }
+            io.run();
+
+            THEN("the file contains the chunks in submission order") {
+                REQUIRE_FALSE(failed);
+                Buffer expected;
+                for(auto& c : chunks)
+                    expected.insert(expected.end(), c.begin(), c.end());
+                REQUIRE(fs.readFile(path) == expected);
+            }
+        }
+    }
+
+    GIVEN("A file appended to directly and through the page cache at the same time") {
+        auto path = working_dir + "/direct_concurrent";
+        const size_t n_appends = 200;
+        // a whole block of the direct I/O alignment
+        Buffer block(4096, 'D');
+        Buffer record(100, 'b');
+
+        WHEN("whole blocks are appended directly while records are appended by another thread") {
+            size_t completed = 0;
+            bool failed = false;
+            std::unique_ptr<boost::asio::io_service::work> work{new boost::asio::io_service::work(io)};
+            std::thread other{[&fs, &path, &record, n_appends]() {
+                for(size_t i = 0; i < n_appends; ++i)
+                    fs.appendToFile(path, record);
+            }};
+            for(size_t i = 0; i < n_appends; ++i) {
+                fs.async_append(path, block, [&](const ErrorCode& ec, size_t) {
+                    failed = failed || ec;
+                    if(++completed == n_appends)
+                        work.reset();
+                }, direct);
+            }
+            io.run();
+            other.join();
+
+            THEN("no append is lost nor overwritten, and no padding is left in the file") {
+                REQUIRE_FALSE(failed);
+                auto content = fs.readFile(path);
+                REQUIRE(content.size() == n_appends * (block.size() + record.size()));
+                REQUIRE(static_cast<size_t>(std::count(content.begin(), content.end(), 'D')) == n_appends * block.size());
+                REQUIRE(static_cast<size_t>(std::count(content.begin(), content.end(), 'b')) == n_appends * record.size());
+            }
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Asynchronous operations on owned buffers", "[fs_async_owned][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager fs(io, 1, test_backend());
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/owned";
+
+    GIVEN("A buffer moved into a write") {
+        Buffer in(10000);
+        for(size_t i = 0; i < in.size(); ++i)
+            in[i] = static_cast<uint8_t>(i);
+        const Buffer expected = in;
+        const uint8_t* storage = in.data();
+
+        WHEN("the write completes") {
+            ErrorCode write_ec{ErrorCode::unknown_error};
+            Buffer returned;
+            fs.async_write(path, std::move(in), [&](const ErrorCode& ec, Buffer b) {
+                write_ec = ec;
+                returned = std::move(b);
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            io.run();
+
+            THEN("the same buffer is handed back and the file holds its content") {
+                REQUIRE(write_ec == ErrorCode::success);
+                REQUIRE(returned.data() == storage);
+                REQUIRE(returned == expected);
+                REQUIRE(fs.readFile(path) == expected);
+            }
+
+            AND_WHEN("the buffer is recycled to read the file back") {
+                io.reset();
+                std::fill(returned.begin(), returned.end(), 0);
+                ErrorCode read_ec{ErrorCode::unknown_error};
+                Buffer out;
+                fs.async_read(path, std::move(returned), [&](const ErrorCode& ec, Buffer b) {
+                    read_ec = ec;
+                    out = std::move(b);
+                });
+                std::this_thread::sleep_for(std::chrono::milliseconds{100});
+                io.run();
+
+                THEN("the content is read into the same storage") {
+                    REQUIRE(read_ec == ErrorCode::success);
+                    REQUIRE(out.data() == storage);
+                    REQUIRE(out == expected);
+                }
+            }
+        }
+    }
+
+    GIVEN("A buffer with enough capacity") {
+        fs.writeFile(path, Buffer(5000, 7));
+        Buffer out;
+        out.reserve(8192);
+        const uint8_t* storage = out.data();
+
+        WHEN("a file is read into it") {
+            ErrorCode read_ec{ErrorCode::unknown_error};
+            fs.async_read(path, out, [&read_ec](const ErrorCode& ec, size_t) { read_ec = ec; });
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            io.run();
+
+            THEN("its storage is reused") {
+                REQUIRE(read_ec == ErrorCode::success);
+                REQUIRE(out.data() == storage);
+                REQUIRE(out == Buffer(5000, 7));
+            }
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Mapping files in memory", "[fs_async_map][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager fs(io, 1, test_backend());
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/mapped";
+    Buffer content(3 * pageSize + 17);
+    for(size_t i = 0; i < content.size(); ++i)
+        content[i] = static_cast<uint8_t>(i * 7);
+    fs.writeFile(path, content);
+
+    GIVEN("A regular file") {
+        WHEN("it is mapped synchronously") {
+            auto region = fs.mapFile(path);
+
+            THEN("the region exposes its content") {
+                REQUIRE(region->size() == content.size());
+                REQUIRE(Buffer(region->begin(), region->end()) == content);
+                REQUIRE(region->advise(MappedRegion::Advice::sequential));
+                REQUIRE(region->advise(MappedRegion::Advice::willneed, pageSize + 1, 100));
+            }
+        }
+
+        WHEN("it is mapped asynchronously") {
+            ErrorCode map_ec{ErrorCode::unknown_error};
+            std::shared_ptr<const MappedRegion> region;
+            fs.async_map_file(path, [&](const ErrorCode& ec, std::shared_ptr<const MappedRegion> r) {
+                map_ec = ec;
+                region = std::move(r);
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            io.run();
+
+            THEN("the region is handed to the completion handler") {
+                REQUIRE(map_ec == ErrorCode::success);
+                REQUIRE(region);
+                REQUIRE(Buffer(region->begin(), region->end()) == content);
+            }
+        }
+    }
+
+    GIVEN("An empty file") {
+        fs.writeFile(path, Buffer{});
+
+        THEN("the region is empty") {
+            auto region = fs.mapFile(path);
+            REQUIRE(region->empty());
+        }
+    }
+
+    GIVEN("A directory") {
+        WHEN("it is mapped asynchronously") {
+            ErrorCode map_ec{ErrorCode::success};
+            std::shared_ptr<const MappedRegion> region;
+            fs.async_map_file(working_dir, [&](const ErrorCode& ec, std::shared_ptr<const MappedRegion> r) {
+                map_ec = ec;
+                region = std::move(r);
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            io.run();
+
+            THEN("an error is returned") {
+                REQUIRE(map_ec != ErrorCode::success);
+                REQUIRE(!region);
+            }
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+/**
+ * run_until runs the handlers posted on io until done becomes true, also across the intervals
+ * in which no handler is pending because the FilesystemManager is still working.
+ */
+static void run_until(boost::asio::io_service& io, const bool& done)
+{
+    while(!done) {
+        io.reset();
+        io.poll();
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+}
+
+SCENARIO("Copying asynchronously", "[fs_async_copy][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager fs(io, 2, test_backend());
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir + "/src/sub", true);
+    Buffer content(2 * pageSize + 5, 42);
+    fs.writeFile(working_dir + "/src/file", content);
+    fs.writeFile(working_dir + "/src/sub/other", Buffer(10, 1));
+
+    GIVEN("A regular file") {
+        WHEN("it is copied") {
+            ErrorCode copy_ec{ErrorCode::unknown_error};
+            size_t copied = 0;
+            fs.async_copy_file(working_dir + "/src/file", working_dir + "/copy", [&](const ErrorCode& ec, size_t size) {
+                copy_ec = ec;
+                copied = size;
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            io.run();
+
+            THEN("the destination holds the same content") {
+                REQUIRE(copy_ec == ErrorCode::success);
+                REQUIRE(copied == content.size());
+                REQUIRE(fs.readFile(working_dir + "/copy") == content);
+            }
+        }
+
+        WHEN("it is copied onto itself") {
+            ErrorCode copy_ec{ErrorCode::success};
+            fs.async_copy_file(working_dir + "/src/file", working_dir + "/src/../src/file", [&](const ErrorCode& ec, size_t) { copy_ec = ec; });
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            io.run();
+
+            THEN("an error is returned and the file is untouched") {
+                REQUIRE(copy_ec != ErrorCode::success);
+                REQUIRE(fs.readFile(working_dir + "/src/file") == content);
+            }
+        }
+    }
+
+    GIVEN("A directory") {
+        for(int i = 0; i < 20; ++i)
+            fs.writeFile(working_dir + "/src/sub/" + std::to_string(i), Buffer(i, i));
+
+        WHEN("it is copied") {
+            ErrorCode copy_ec{ErrorCode::unknown_error};
+            size_t copied = 0;
+            bool done = false;
+            std::vector<FilesystemManager::CopyProgress> progress;
+            fs.async_copy_directory(working_dir + "/src", working_dir + "/dst", [&](const ErrorCode& ec, size_t size) {
+                copy_ec = ec;
+                copied = size;
+                done = true;
+            }, [&progress](const FilesystemManager::CopyProgress& p) { progress.push_back(p); }, 3);
+            run_until(io, done);
+
+            THEN("the whole tree is copied and the progress is reported for every file") {
+                REQUIRE(copy_ec == ErrorCode::success);
+                REQUIRE(fs.readFile(working_dir + "/dst/file") == content);
+                REQUIRE(fs.readFile(working_dir + "/dst/sub/other") == Buffer(10, 1));
+                for(int i = 0; i < 20; ++i)
+                    REQUIRE(fs.readFile(working_dir + "/dst/sub/" + std::to_string(i)) == Buffer(i, i));
+
+                REQUIRE(progress.size() == 22);
+                REQUIRE(progress.back().files_copied == 22);
+                REQUIRE(progress.back().files_total == 22);
+                REQUIRE(progress.back().bytes_copied == progress.back().bytes_total);
+                REQUIRE(copied == progress.back().bytes_total);
+            }
+        }
+
+        WHEN("it is copied inside an existing directory") {
+            fs.createDirectory(working_dir + "/dst", false);
+            ErrorCode copy_ec{ErrorCode::unknown_error};
+            bool done = false;
+            fs.async_copy_directory(working_dir + "/src", working_dir + "/dst", [&](const ErrorCode& ec, size_t) { copy_ec = ec; done = true; });
+            run_until(io, done);
+
+            THEN("the tree is copied inside it") {
+                REQUIRE(copy_ec == ErrorCode::success);
+                REQUIRE(fs.readFile(working_dir + "/dst/src/sub/other") == Buffer(10, 1));
+            }
+        }
+    }
+
+    GIVEN("A path that is not a directory") {
+        WHEN("it is copied as a directory") {
+            ErrorCode copy_ec{ErrorCode::success};
+            bool done = false;
+            fs.async_copy_directory(working_dir + "/src/file", working_dir + "/dst", [&](const ErrorCode& ec, size_t) { copy_ec = ec; done = true; });
+            run_until(io, done);
+
+            THEN("an error is returned") {
+                REQUIRE(copy_ec != ErrorCode::success);
+            }
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Asynchronous operations with priority classes", "[fs_async_priority][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.backend = test_backend();
+    options.priority_aging = 2;
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    Buffer small(10, 2);
+    size_t completed = 0;
+    size_t expected = 6;
+    bool done = false;
+    auto record = [&]() {
+        return [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            done = ++completed == expected;
+        };
+    };
+    // the worker is held at the start of the first operation while the other ones are queued
+    auto recorder = std::make_shared<Recorder>();
+    set_trace_observer(recorder);
+    auto big = working_dir + "/big";
+    recorder->hold(big);
+
+    GIVEN("Bulk operations queued before interactive ones") {
+        fs.async_write(big, small, record());
+        REQUIRE(recorder->wait_held(big));
+        fs.async_append(working_dir + "/bulk", small, record(), Priority::bulk);
+        for(int i = 0; i < 4; ++i)
+            fs.async_write(working_dir + "/interactive" + std::to_string(i), small, record(), Priority::interactive);
+        recorder->release(big);
+
+        WHEN("the worker gets to them") {
+            run_until(io, done);
+
+            THEN("interactive operations overtake the bulk one, which is served after being overtaken priority_aging times") {
+                REQUIRE(recorder->started() == std::vector<std::string>{"big", "interactive", "interactive", "bulk", "interactive", "interactive"});
+            }
+        }
+    }
+
+    GIVEN("A bulk write followed by an interactive read of the same file") {
+        Buffer written(1000, 3);
+        Buffer read;
+        ErrorCode read_ec{ErrorCode::success};
+        expected = 4;
+        fs.async_write(big, small, record());
+        REQUIRE(recorder->wait_held(big));
+        fs.async_write(working_dir + "/shared", written, record(), Priority::bulk);
+        fs.async_write(working_dir + "/interactive", small, record(), Priority::interactive);
+        fs.async_read(working_dir + "/shared", read, [&](const ErrorCode& ec, size_t) {
+            read_ec = ec;
+            done = ++completed == expected;
+        }, Priority::interactive);
+        recorder->release(big);
+
+        WHEN("the worker gets to them") {
+            run_until(io, done);
+
+            THEN("the read overtakes only the operations on other paths, and sees the data written") {
+                REQUIRE(recorder->started() == std::vector<std::string>{"big", "interactive", "shared", "shared"});
+                REQUIRE(read_ec == ErrorCode::success);
+                REQUIRE(read == written);
+            }
+        }
+    }
+
+    set_trace_observer(nullptr);
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Creating a FilesystemManager without priority aging", "[fs_async_priority][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.priority_aging = 0;
+    REQUIRE_THROWS_AS(FilesystemManager(io, options), std::invalid_argument);
+}
+
+SCENARIO("Queued appends to the same file", "[fs_async_coalesce][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager fs(io, 1, test_backend());
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/appended";
+    Buffer big(16 * 1024 * 1024, 1);
+    std::vector<Buffer> chunks;
+    for(int i = 0; i < 10; ++i)
+        chunks.emplace_back(100 + i, static_cast<uint8_t>(i));
+
+    GIVEN("Many appends queued back to back while the worker is busy") {
+        fs.async_write(working_dir + "/big", big, [](const ErrorCode&, size_t) {});
+        std::vector<size_t> sizes;
+        for(const auto& c : chunks)
+            fs.async_append(path, c, [&sizes](const ErrorCode& ec, size_t size) {
+                REQUIRE(ec == ErrorCode::success);
+                sizes.push_back(size);
+            });
+
+        WHEN("they are performed") {
+            std::this_thread::sleep_for(std::chrono::milliseconds{300});
+            io.run();
+
+            THEN("each handler receives its own size and the file holds the chunks in order") {
+                REQUIRE(sizes.size() == chunks.size());
+                Buffer expected;
+                for(size_t i = 0; i < chunks.size(); ++i) {
+                    REQUIRE(sizes[i] == chunks[i].size());
+                    expected.insert(expected.end(), chunks[i].begin(), chunks[i].end());
+                }
+                REQUIRE(fs.readFile(path) == expected);
+            }
+        }
+    }
+
+    GIVEN("Appends to a path that is not admitted") {
+        fs.createDirectory(path, false);
+        std::vector<ErrorCode> results;
+        for(const auto& c : chunks)
+            fs.async_append(path, c, [&results](const ErrorCode& ec, size_t) { results.push_back(ec); });
+
+        WHEN("they are performed") {
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            io.run();
+
+            THEN("every handler receives the error") {
+                REQUIRE(results.size() == chunks.size());
+                for(const auto& ec : results)
+                    REQUIRE(ec != ErrorCode::success);
+            }
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Asynchronous operations with cached descriptors", "[fs_async_fd_cache][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.workers = 2;
+    options.fd_cache_size = 2;
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/cached";
+    Buffer first(1000, 1), second(10, 2), third(100, 3);
+
+    GIVEN("A file written, appended to and read through the cache") {
+        Buffer out;
+        std::vector<ErrorCode> results;
+        size_t expected_results = 3;
+        bool done = false;
+        auto handler = [&](const ErrorCode& ec, size_t) {
+            results.push_back(ec);
+            done = results.size() == expected_results;
+        };
+        fs.async_write(path, first, handler);
+        fs.async_append(path, second, handler);
+        fs.async_read(path, out, handler);
+        run_until(io, done);
+
+        THEN("every operation sees the previous ones") {
+            for(const auto& ec : results)
+                REQUIRE(ec == ErrorCode::success);
+            Buffer expected{first};
+            expected.insert(expected.end(), second.begin(), second.end());
+            REQUIRE(out == expected);
+        }
+
+        WHEN("it is overwritten with a shorter content") {
+            results.clear();
+            expected_results = 2;
+            done = false;
+            fs.async_write(path, second, handler);
+            fs.async_read(path, out, handler);
+            run_until(io, done);
+
+            THEN("nothing of the former content is left") {
+                REQUIRE(out == second);
+                REQUIRE(boost::filesystem::file_size(path) == second.size());
+            }
+        }
+
+        WHEN("it is removed and created again") {
+            REQUIRE(fs.removeFile(path));
+            results.clear();
+            expected_results = 2;
+            done = false;
+            fs.async_append(path, third, handler);
+            fs.async_read(path, out, handler);
+            run_until(io, done);
+
+            THEN("the new file is accessed") {
+                REQUIRE(out == third);
+                REQUIRE(fs.readFile(path) == third);
+            }
+        }
+
+        WHEN("another file is moved in its place") {
+            auto other = working_dir + "/other";
+            fs.writeFile(other, third);
+            fs.move(other, path);
+            results.clear();
+            expected_results = 1;
+            done = false;
+            fs.async_read(path, out, handler);
+            run_until(io, done);
+
+            THEN("the moved file is read") {
+                REQUIRE(out == third);
+            }
+        }
+
+        WHEN("another writer appends to it meanwhile") {
+            const size_t n = 1000;
+            Buffer external(10, 4);
+            std::atomic<bool> stop{false};
+            size_t appended = 0;
+            std::thread writer{[&]() {
+                for(; !stop; ++appended)
+                    appendToFile(path, external);
+            }};
+            // one at a time, so that the appends are not gathered in a single write
+            for(size_t i = 0; i < n; ++i) {
+                results.clear();
+                expected_results = 1;
+                done = false;
+                fs.async_append(path, second, handler);
+                run_until(io, done);
+                REQUIRE(results.front() == ErrorCode::success);
+            }
+            stop = true;
+            writer.join();
+
+            THEN("no append overwrites another one") {
+                auto content = fs.readFile(path);
+                REQUIRE(content.size() == first.size() + (n + 1) * second.size() + appended * external.size());
+                REQUIRE(static_cast<size_t>(std::count(content.begin(), content.end(), 2)) == (n + 1) * second.size());
+            }
+        }
+
+        WHEN("more files than the cache can hold are accessed") {
+            results.clear();
+            std::vector<Buffer> ins, outs(5);
+            for(size_t i = 0; i < outs.size(); ++i)
+                ins.emplace_back(i + 1, static_cast<uint8_t>(i));
+            expected_results = 2 * outs.size();
+            done = false;
+            for(size_t i = 0; i < outs.size(); ++i) {
+                auto p = working_dir + "/many" + std::to_string(i);
+                fs.async_write(p, ins[i], handler);
+                fs.async_read(p, outs[i], handler);
+            }
+            run_until(io, done);
+
+            THEN("each of them holds its own content") {
+                for(size_t i = 0; i < outs.size(); ++i)
+                    REQUIRE(outs[i] == ins[i]);
+            }
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Operations with cached metadata", "[fs_async_metadata][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.workers = 2;
+    options.backend = test_backend();
+    options.metadata_ttl = std::chrono::hours{1};
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/file";
+    Buffer content(100, 7);
+
+    GIVEN("Paths changed through the manager") {
+        THEN("the changes are seen at once") {
+            REQUIRE_FALSE(fs.exists(path));
+            fs.writeFile(path, content);
+            REQUIRE(fs.exists(path));
+            fs.move(path, path + "2");
+            REQUIRE_FALSE(fs.exists(path));
+            REQUIRE(fs.exists(path + "2"));
+            REQUIRE(fs.removeFile(path + "2"));
+            REQUIRE_FALSE(fs.exists(path + "2"));
+
+            REQUIRE_FALSE(fs.exists(working_dir + "/a"));
+            fs.createDirectory(working_dir + "/a/b/c", true);
+            REQUIRE(fs.exists(working_dir + "/a"));
+            REQUIRE(fs.exists(working_dir + "/a/b/c"));
+            fs.removeDirectory(working_dir + "/a");
+            REQUIRE_FALSE(fs.exists(working_dir + "/a/b"));
+        }
+
+        WHEN("a file is replaced by a directory") {
+            fs.writeFile(path, content);
+            REQUIRE(fs.removeFile(path));
+            fs.createDirectory(path, false);
+            ErrorCode result{ErrorCode::success};
+            bool done = false;
+            fs.async_write(path, content, [&](const ErrorCode& ec, size_t) {
+                result = ec;
+                done = true;
+            });
+            run_until(io, done);
+
+            THEN("writing to it fails as without the cache") {
+                REQUIRE(result == ErrorCode::invalid_argument);
+            }
+        }
+
+        WHEN("a file is written and appended to asynchronously") {
+            Buffer out;
+            size_t completed = 0;
+            bool done = false;
+            auto handler = [&](const ErrorCode& ec, size_t) {
+                REQUIRE(ec == ErrorCode::success);
+                done = ++completed == 3;
+            };
+            fs.async_write(path, content, handler);
+            fs.async_append(path, content, handler);
+            fs.async_read(path, out, handler);
+            run_until(io, done);
+
+            THEN("the operations see each other") {
+                REQUIRE(out.size() == 2 * content.size());
+                REQUIRE(fs.exists(path));
+            }
+        }
+    }
+
+    GIVEN("A path created behind the manager") {
+        FilesystemManager::Options short_ttl;
+        short_ttl.metadata_ttl = std::chrono::milliseconds{50};
+        FilesystemManager fs_short(io, short_ttl);
+        REQUIRE_FALSE(fs_short.exists(path));
+        cynny::cynnypp::filesystem::writeFile(path, content);
+
+        THEN("it is seen once the cached metadata expire") {
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+            REQUIRE(fs_short.exists(path));
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Batches of asynchronous operations", "[fs_async_batch][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager fs(io, 4, test_backend());
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    std::vector<Buffer> contents;
+    for(size_t i = 0; i < 50; ++i)
+        contents.emplace_back(100 + i, static_cast<uint8_t>(i));
+    auto path = [](size_t i) { return working_dir + "/batch" + std::to_string(i); };
+
+    GIVEN("A batch writing many files and appending to them") {
+        std::vector<FilesystemManager::BatchOperation> ops;
+        for(size_t i = 0; i < contents.size(); ++i) {
+            ops.push_back(FilesystemManager::BatchOperation::write(path(i), contents[i]));
+            ops.push_back(FilesystemManager::BatchOperation::append(path(i), contents[i]));
+        }
+        ErrorCode result{ErrorCode::unknown_error};
+        std::vector<FilesystemManager::BatchResult> results;
+        size_t calls = 0;
+        bool done = false;
+        fs.async_batch(ops, [&](const ErrorCode& ec, const std::vector<FilesystemManager::BatchResult>& r) {
+            result = ec;
+            results = r;
+            done = ++calls == 1;
+        });
+        run_until(io, done);
+
+        THEN("the handler is invoked once with the result of every operation") {
+            REQUIRE(calls == 1);
+            REQUIRE(result == ErrorCode::success);
+            REQUIRE(results.size() == ops.size());
+            for(size_t i = 0; i < results.size(); ++i) {
+                REQUIRE(results[i].ec == ErrorCode::success);
+                REQUIRE(results[i].size == contents[i / 2].size());
+            }
+        }
+
+        WHEN("the files are read back with another batch, along with a missing one") {
+            std::vector<Buffer> outs(contents.size() + 1);
+            std::vector<FilesystemManager::BatchOperation> reads;
+            for(size_t i = 0; i < contents.size(); ++i)
+                reads.push_back(FilesystemManager::BatchOperation::read(path(i), outs[i]));
+            reads.push_back(FilesystemManager::BatchOperation::read(working_dir + "/missing", outs.back()));
+            done = false;
+            fs.async_batch(reads, [&](const ErrorCode& ec, const std::vector<FilesystemManager::BatchResult>& r) {
+                result = ec;
+                results = r;
+                done = true;
+            }, Priority::interactive);
+            run_until(io, done);
+
+            THEN("the writes and the appends have been performed in order and the failure is reported") {
+                REQUIRE(result != ErrorCode::success);
+                REQUIRE(results.back().ec != ErrorCode::success);
+                for(size_t i = 0; i < contents.size(); ++i) {
+                    Buffer expected{contents[i]};
+                    expected.insert(expected.end(), contents[i].begin(), contents[i].end());
+                    REQUIRE(results[i].ec == ErrorCode::success);
+                    REQUIRE(outs[i] == expected);
+                }
+            }
+        }
+    }
+
+    GIVEN("An empty batch") {
+        bool done = false;
+        fs.async_batch({}, [&](const ErrorCode& ec, const std::vector<FilesystemManager::BatchResult>& r) {
+            REQUIRE(ec == ErrorCode::success);
+            REQUIRE(r.empty());
+            done = true;
+        });
+        run_until(io, done);
+        THEN("the handler is invoked anyway") {
+            REQUIRE(done);
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Cancelling queued operations", "[fs_async_cancel][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager fs(io, 1, test_backend());
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/cancelled";
+    Buffer content(100, 5);
+    Buffer big(16 * 1024 * 1024, 1);
+    std::vector<ErrorCode> results;
+    bool done = false;
+    auto handler = [&](const ErrorCode& ec, size_t) {
+        results.push_back(ec);
+        done = results.size() == 2;
+    };
+
+    GIVEN("Operations queued behind a long one") {
+        CancellationToken token;
+        SubmitOptions opts;
+        opts.token = &token;
+        fs.async_write(path, big, handler);
+        fs.async_append(path, content, handler, opts);
+        token.cancel();
+        run_until(io, done);
+
+        THEN("the cancelled ones are completed without being performed") {
+            REQUIRE(results[0] == ErrorCode::success);
+            REQUIRE(results[1] == ErrorCode::stopped);
+            REQUIRE(boost::filesystem::file_size(path) == big.size());
+        }
+    }
+
+    GIVEN("Operations whose deadline has passed") {
+        SubmitOptions opts;
+        opts.deadline = std::chrono::steady_clock::now();
+        fs.async_append(path, content, handler, opts);
+        Buffer out;
+        opts.priority = Priority::bulk;
+        opts.deadline -= std::chrono::seconds{1};
+        fs.async_read(working_dir, out, handler, opts);
+        run_until(io, done);
+
+        THEN("they are completed without being performed") {
+            REQUIRE(results[0] == ErrorCode::stopped);
+            REQUIRE(results[1] == ErrorCode::stopped);
+            REQUIRE_FALSE(fs.exists(path));
+        }
+    }
+
+    GIVEN("Operations with a token that is not cancelled and a far deadline") {
+        CancellationToken token;
+        Buffer out;
+        SubmitOptions opts;
+        opts.token = &token;
+        opts.deadline = std::chrono::steady_clock::now() + std::chrono::hours{1};
+        fs.async_write(path, content, handler, opts);
+        fs.async_read(path, out, handler, opts);
+        run_until(io, done);
+
+        THEN("they are performed") {
+            REQUIRE(results[0] == ErrorCode::success);
+            REQUIRE(results[1] == ErrorCode::success);
+            REQUIRE(out == content);
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Limits on the queued operations", "[fs_async_backpressure][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.backend = test_backend();
+    options.max_queued_operations = 2;
+    options.max_queued_bytes = 1024 * 1024;
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/limited";
+    Buffer big(16 * 1024 * 1024, 1);
+    Buffer small(100, 2);
+    std::vector<ErrorCode> results;
+    auto handler = [&results](const ErrorCode& ec, size_t) { results.push_back(ec); };
+
+    GIVEN("An operation larger than the limit on the bytes, submitted when nothing is queued") {
+        fs.async_write(path, big, handler);
+
+        THEN("it is accepted, but the following ones have to wait for it") {
+            REQUIRE(fs.queued_operations() == 1);
+            REQUIRE(fs.queued_bytes() == big.size());
+            fs.async_append(path, small, handler);
+            Buffer out;
+            std::vector<FilesystemManager::BatchOperation> ops{FilesystemManager::BatchOperation::read(path, out)};
+            ErrorCode batch_ec;
+            fs.async_batch(ops, [&batch_ec](const ErrorCode& ec, const std::vector<FilesystemManager::BatchResult>&) { batch_ec = ec; });
+
+            bool ready = false;
+            fs.async_wait_capacity(small.size(), [&](const ErrorCode& ec, size_t) {
+                REQUIRE(ec == ErrorCode::success);
+                // the write has been completed before
+                REQUIRE(results.size() == 2);
+                fs.async_append(path, small, handler);
+                ready = true;
+            });
+            run_until(io, ready);
+            while(results.size() < 3) {
+                io.reset();
+                io.run_one();
+            }
+
+            REQUIRE(results[0] == ErrorCode::would_block);
+            REQUIRE(batch_ec == ErrorCode::would_block);
+            REQUIRE(results[1] == ErrorCode::success);
+            REQUIRE(results[2] == ErrorCode::success);
+            REQUIRE(boost::filesystem::file_size(path) == big.size() + small.size());
+            REQUIRE(fs.queued_operations() == 0);
+            REQUIRE(fs.queued_bytes() == 0);
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Scatter/gather operations", "[fs_async_vectored][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.backend = test_backend();
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/vectored";
+    std::string header = "header:", body = "the body", trailer = ":trailer";
+
+    GIVEN("A file written from several buffers") {
+        bool done = false;
+        fs.writeFile(path, Buffer(1000, 'x'));
+        FilesystemManager::ConstBuffers bufs{boost::asio::buffer(header), boost::asio::buffer(body), boost::asio::buffer(trailer)};
+        fs.async_writev(path, bufs, [&](const ErrorCode& ec, size_t size) {
+            REQUIRE(ec == ErrorCode::success);
+            REQUIRE(size == header.size() + body.size() + trailer.size());
+            done = true;
+        });
+        run_until(io, done);
+
+        THEN("its content is replaced by their concatenation") {
+            auto content = fs.readFile(path);
+            REQUIRE(std::string(content.begin(), content.end()) == header + body + trailer);
+        }
+
+        THEN("a range can be read back into several buffers") {
+            std::array<char, 3> first;
+            std::array<char, 100> second;
+            second.fill(0);
+            FilesystemManager::MutableBuffers out{boost::asio::buffer(first), boost::asio::buffer(second)};
+            done = false;
+            fs.async_readv(path, header.size(), out, [&](const ErrorCode& ec, size_t size) {
+                REQUIRE(ec == ErrorCode::success);
+                // the file ends before the buffers are full
+                REQUIRE(size == body.size() + trailer.size());
+                done = true;
+            });
+            run_until(io, done);
+            REQUIRE(std::string(first.data(), first.size()) == "the");
+            REQUIRE(std::string(second.data()) == " body:trailer");
+        }
+    }
+
+    GIVEN("A file that does not exist") {
+        THEN("it cannot be read") {
+            bool done = false;
+            char c;
+            FilesystemManager::MutableBuffers out{boost::asio::buffer(&c, 1)};
+            fs.async_readv(path, 0, out, [&](const ErrorCode& ec, size_t) {
+                REQUIRE(ec == ErrorCode::invalid_argument);
+                done = true;
+            });
+            run_until(io, done);
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Positional operations", "[fs_async_positional][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.backend = test_backend();
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/positional";
+    std::string digits = "0123456789";
+    fs.writeFile(path, Buffer(digits.begin(), digits.end()));
+
+    GIVEN("A range written in the middle of a file") {
+        bool done = false;
+        Buffer in{'a', 'b'};
+        fs.async_pwrite(path, 3, in, [&](const ErrorCode& ec, size_t size) {
+            REQUIRE(ec == ErrorCode::success);
+            REQUIRE(size == in.size());
+            done = true;
+        });
+        run_until(io, done);
+
+        THEN("the rest of the file is untouched") {
+            auto content = fs.readFile(path);
+            REQUIRE(std::string(content.begin(), content.end()) == "012ab56789");
+        }
+
+        THEN("a range can be read back, up to the end of the file") {
+            Buffer out;
+            done = false;
+            fs.async_pread(path, 4, 3, out, [&](const ErrorCode& ec, size_t size) {
+                REQUIRE(ec == ErrorCode::success);
+                REQUIRE(size == 3);
+                done = true;
+            });
+            run_until(io, done);
+            REQUIRE(std::string(out.begin(), out.end()) == "b56");
+
+            done = false;
+            fs.async_pread(path, 8, 100, out, [&](const ErrorCode& ec, size_t size) {
+                REQUIRE(ec == ErrorCode::success);
+                REQUIRE(size == 2);
+                done = true;
+            });
+            run_until(io, done);
+            REQUIRE(std::string(out.begin(), out.end()) == "89");
+        }
+    }
+
+    GIVEN("A range written past the end of a file") {
+        bool done = false;
+        Buffer in{'z'};
+        fs.async_pwrite(path, 12, in, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            done = true;
+        });
+        run_until(io, done);
+
+        THEN("the file is extended with zeros") {
+            auto content = fs.readFile(path);
+            REQUIRE(content.size() == 13);
+            REQUIRE(content[10] == 0);
+            REQUIRE(content[11] == 0);
+            REQUIRE(content[12] == 'z');
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Durable writes and appends", "[fs_async_durability][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.backend = test_backend();
+    options.sync_window = std::chrono::milliseconds(50);
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/durable";
+    Buffer first(1000, 'a'), second(100, 'b');
+    SubmitOptions data, full;
+    data.durability = Durability::data;
+    full.durability = Durability::full;
+
+    GIVEN("A durable write followed by durable appends to the same file") {
+        std::vector<ErrorCode> results;
+        auto handler = [&results](const ErrorCode& ec, size_t) { results.push_back(ec); };
+        fs.async_write(path, first, handler, full);
+        for(int i = 0; i < 10; ++i)
+            fs.async_append(path, second, handler, data);
+        bool done = false;
+        fs.async_append(path, second, [&](const ErrorCode& ec, size_t size) {
+            REQUIRE(ec == ErrorCode::success);
+            REQUIRE(size == second.size());
+            done = true;
+        }, full);
+        run_until(io, done);
+
+        THEN("all the handlers are invoked in order once the data is synced") {
+            REQUIRE(results.size() == 11);
+            for(const auto& ec : results)
+                REQUIRE(ec == ErrorCode::success);
+            REQUIRE(boost::filesystem::file_size(path) == first.size() + 11 * second.size());
+        }
+    }
+
+    GIVEN("A durable append queued between two long writes") {
+        // the worker is held at the start of the first write while the others are queued. The threads backend
+        // performs the second one synchronously, so holding it until the append is durable makes it long; the io_uring
+        // backend has to reap the completions meanwhile, so there the write must be long by itself
+        auto recorder = std::make_shared<Recorder>();
+        set_trace_observer(recorder);
+        bool threads = test_backend() == FilesystemManager::Backend::threads;
+        recorder->hold(path + ".first");
+        if(threads)
+            recorder->hold(path + ".second");
+        Buffer long_buffer(threads ? 1024 * 1024 : 32 * 1024 * 1024, 'h');
+        bool durable_done = false, long_done = false, overtaken = false;
+        fs.async_write(path + ".first", long_buffer, [](const ErrorCode& ec, size_t) { REQUIRE(ec == ErrorCode::success); });
+        REQUIRE(recorder->wait_held(path + ".first"));
+        fs.async_append(path, second, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            overtaken = recorder->ended(path + ".second");
+            durable_done = true;
+            recorder->release(path + ".second");
+        }, data);
+        fs.async_write(path + ".second", long_buffer, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            long_done = true;
+        });
+        recorder->release(path + ".first");
+        run_until(io, long_done);
+        set_trace_observer(nullptr);
+
+        THEN("its sync does not wait for the second write") {
+            REQUIRE(durable_done);
+            REQUIRE_FALSE(overtaken);
+        }
+    }
+
+    GIVEN("Durable positional and gather writes") {
+        std::vector<ErrorCode> results;
+        auto handler = [&results](const ErrorCode& ec, size_t) { results.push_back(ec); };
+        fs.async_pwrite(path, 0, first, handler, full);
+        fs.async_writev(path + ".gathered", {boost::asio::buffer(first), boost::asio::buffer(second)}, handler, full);
+        bool done = false;
+        fs.async_write_atomic(path + ".atomic", second, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            done = true;
+        }, data);
+        run_until(io, done);
+
+        THEN("their handlers are invoked once the data is synced") {
+            REQUIRE(results.size() == 2);
+            for(const auto& ec : results)
+                REQUIRE(ec == ErrorCode::success);
+            REQUIRE(fs.readFile(path) == first);
+            REQUIRE(boost::filesystem::file_size(path + ".gathered") == first.size() + second.size());
+        }
+    }
+
+    GIVEN("A durable write that fails") {
+        // the handler receives the error without waiting for any sync
+        bool done = false;
+        fs.async_write(working_dir, first, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::invalid_argument);
+            done = true;
+        }, full);
+        run_until(io, done);
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Atomic writes", "[fs_async_atomic][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.backend = test_backend();
+    options.fd_cache_size = 4;
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/atomic";
+    Buffer content(10000, 'n');
+
+    GIVEN("A file replaced atomically") {
+        fs.writeFile(path, Buffer(100, 'o'));
+        // keep a descriptor of the former file in the cache
+        Buffer out;
+        bool done = false;
+        fs.async_read(path, out, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            done = true;
+        });
+        run_until(io, done);
+
+        done = false;
+        fs.async_write_atomic(path, content, [&](const ErrorCode& ec, size_t size) {
+            REQUIRE(ec == ErrorCode::success);
+            REQUIRE(size == content.size());
+            done = true;
+        });
+        run_until(io, done);
+
+        THEN("it has the new content only, and no temporary file is left") {
+            done = false;
+            fs.async_read(path, out, [&](const ErrorCode& ec, size_t) {
+                REQUIRE(ec == ErrorCode::success);
+                done = true;
+            });
+            run_until(io, done);
+            REQUIRE(out == content);
+            REQUIRE(std::distance(boost::filesystem::directory_iterator(working_dir), boost::filesystem::directory_iterator()) == 1);
+        }
+    }
+
+    GIVEN("A file readable only by its owner replaced atomically") {
+        namespace bfs = boost::filesystem;
+        fs.writeFile(path, Buffer(100, 'o'));
+        bfs::permissions(path, bfs::owner_read | bfs::owner_write);
+        bool done = false;
+        fs.async_write_atomic(path, content, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            done = true;
+        });
+        run_until(io, done);
+
+        THEN("the new file keeps its permissions") {
+            REQUIRE(fs.readFile(path) == content);
+            REQUIRE(bfs::status(path).permissions() == (bfs::owner_read | bfs::owner_write));
+        }
+    }
+
+    GIVEN("A file that does not exist") {
+        bool done = false;
+        fs.async_write_atomic(path, content, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            done = true;
+        });
+        run_until(io, done);
+
+        THEN("it is created") {
+            REQUIRE(fs.readFile(path) == content);
+        }
+    }
+
+    GIVEN("A path that is a directory") {
+        bool done = false;
+        fs.async_write_atomic(working_dir, content, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::invalid_argument);
+            done = true;
+        });
+        run_until(io, done);
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Metrics of the operations", "[fs_async_metrics][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.backend = test_backend();
+    options.metrics = true;
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/metered";
+    Buffer in(4096, 'm'), out;
+
+    GIVEN("A write and a read completed") {
+        bool done = false;
+        fs.async_write(path, in, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            fs.async_read(path, out, [&](const ErrorCode& ec, size_t) {
+                REQUIRE(ec == ErrorCode::success);
+                done = true;
+            });
+        });
+        run_until(io, done);
+
+        THEN("their latencies are recorded, and nothing is left in flight") {
+            auto m = fs.metrics();
+            REQUIRE(m.operations.size() == 2);
+            for(const auto& name : {"async_write", "async_read"}) {
+                const auto& op = m.operations.at(name);
+                REQUIRE(op.queue_wait.count == 1);
+                REQUIRE(op.execution.count == 1);
+                REQUIRE(op.dispatch.count == 1);
+                REQUIRE(op.execution.max > 0);
+            }
+            REQUIRE(m.queue_depth == 0);
+            REQUIRE(m.bytes_in_flight == 0);
+        }
+    }
+
+    GIVEN("A manager without metrics") {
+        FilesystemManager plain(io);
+        THEN("nothing is recorded") {
+            auto m = plain.metrics();
+            REQUIRE(m.operations.empty());
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Completion handlers posted together", "[fs_async_completions][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager fs(io, 1, test_backend());
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/completions";
+    Buffer big(16 * 1024 * 1024, 'c'), small(16, 'c');
+    std::vector<size_t> order;
+
+    GIVEN("Many operations submitted while the worker is busy") {
+        const size_t n = 100;
+        fs.async_write(path, big, [&order, n](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            order.push_back(n);
+        });
+        for(size_t i = 0; i < n; ++i) {
+            fs.async_append(path, small, [&order, i](const ErrorCode& ec, size_t) {
+                REQUIRE(ec == ErrorCode::success);
+                order.push_back(i);
+            });
+        }
+        size_t posted = 0;
+        while(order.size() < n + 1) {
+            io.reset();
+            posted += io.poll();
+            std::this_thread::sleep_for(std::chrono::milliseconds{1});
+        }
+
+        THEN("their handlers run in order, and are posted in fewer handlers than the operations") {
+            REQUIRE(order.front() == n);
+            for(size_t i = 0; i < n; ++i)
+                REQUIRE(order[i + 1] == i);
+            // the io_uring backend performs the operations on a path one at a time, and posts the handlers
+            // whenever it waits for the one in flight
+            if(test_backend() == FilesystemManager::Backend::threads)
+                REQUIRE(posted < n + 1);
+        }
+    }
+
+    GIVEN("Short operations queued between two long ones") {
+        // the worker is held at the start of the first long write while the others are queued, and at the start
+        // of the second one until the handlers of the short ones have run; only the threads backend performs it
+        // synchronously, while the io_uring one has to reap the completions meanwhile, so there it must be long by itself
+        auto recorder = std::make_shared<Recorder>();
+        set_trace_observer(recorder);
+        bool threads = test_backend() == FilesystemManager::Backend::threads;
+        recorder->hold(path + ".first");
+        if(threads)
+            recorder->hold(path + ".big");
+        Buffer long_buffer(threads ? 1024 * 1024 : 32 * 1024 * 1024, 'c');
+        bool short_done = false, long_done = false, overtaken = false;
+        fs.writeFile(path, small);
+        fs.async_write(path + ".first", long_buffer, [](const ErrorCode& ec, size_t) { REQUIRE(ec == ErrorCode::success); });
+        REQUIRE(recorder->wait_held(path + ".first"));
+        Buffer out[2];
+        for(size_t i = 0; i < 2; ++i) {
+            fs.async_pread(path, 0, small.size(), out[i], [&, i](const ErrorCode& ec, size_t) {
+                REQUIRE(ec == ErrorCode::success);
+                overtaken = overtaken || recorder->ended(path + ".big");
+                short_done = i == 1;
+                if(short_done)
+                    recorder->release(path + ".big");
+            }, Priority::interactive);
+        }
+        fs.async_write(path + ".big", long_buffer, [&](const ErrorCode& ec, size_t) {
+            REQUIRE(ec == ErrorCode::success);
+            long_done = true;
+        });
+        recorder->release(path + ".first");
+        run_until(io, long_done);
+        set_trace_observer(nullptr);
+
+        THEN("the handlers of the short ones run before the following long one is over") {
+            REQUIRE(short_done);
+            REQUIRE_FALSE(overtaken);
+        }
+    }
+
+    GIVEN("A handler throwing an exception") {
+        const size_t n = 10;
+        for(size_t i = 0; i < n; ++i) {
+            fs.async_append(path, small, [&order, i](const ErrorCode&, size_t) {
+                order.push_back(i);
+                if(i == 1)
+                    throw std::runtime_error("handler failure");
+            });
+        }
+
+        THEN("the handlers following it run as well, in order") {
+            bool thrown = false;
+            while(order.size() < n) {
+                io.reset();
+                try {
+                    io.poll();
+                }
+                catch(const std::runtime_error&) {
+                    thrown = true;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+            }
+            REQUIRE(thrown);
+            for(size_t i = 0; i < n; ++i)
+                REQUIRE(order[i] == i);
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
+
+SCENARIO("Tracing the operations", "[fs_async_trace][fs_async][fs]") {
+    boost::asio::io_service io;
+    FilesystemManager::Options options;
+    options.backend = test_backend();
+    FilesystemManager fs(io, options);
+    fs.removeDirectory(working_dir);
+    fs.createDirectory(working_dir, true);
+    auto path = working_dir + "/traced";
+    Buffer in(10000, 't');
+    fs.writeFile(path, in);
+
+    GIVEN("An observer installed while a stream is read within a scope") {
+        auto recorder = std::make_shared<Recorder>();
+        set_trace_observer(recorder);
+        const uint64_t transaction = next_trace_id();
+        {
+            TraceScope scope{transaction};
+            auto stream = fs.make_chunked_stream(path, 4096);
+            bool done = false;
+            std::function<void(const ErrorCode&, Buffer)> next = [&](const ErrorCode& ec, Buffer) {
+                if(ec == ErrorCode::end_of_file)
+                    done = true;
+                else
+                    stream->next_chunk(next);
+            };
+            stream->next_chunk(next);
+            run_until(io, done);
+        }
+        set_trace_observer(nullptr);
+
+        THEN("each read reports all its phases, as a child of the stream, which is a child of the scope") {
+            uint64_t stream_id = 0;
+            for(const auto& r : recorder->records)
+                if(r.name == "chunked_stream" && r.phase == TracePhase::enqueue) {
+                    REQUIRE(r.parent == transaction);
+                    stream_id = r.id;
+                }
+            REQUIRE(stream_id != 0);
+
+            size_t reads = 0;
+            for(const auto& r : recorder->records) {
+                if(r.name != "async_read_chunk" || r.phase != TracePhase::enqueue)
+                    continue;
+                ++reads;
+                REQUIRE(r.parent == stream_id);
+                std::vector<TracePhase> phases;
+                for(const auto& other : recorder->records)
+                    if(other.id == r.id)
+                        phases.push_back(other.phase);
+                REQUIRE(phases == std::vector<TracePhase>({TracePhase::enqueue, TracePhase::start, TracePhase::end, TracePhase::complete}));
+            }
+            REQUIRE(reads == 3);
+        }
+    }
+
+    GIVEN("A Chrome trace sink") {
+        auto trace_path = working_dir + "/trace.json";
+        {
+            auto sink = std::make_shared<ChromeTraceSink>(trace_path);
+            set_trace_observer(sink);
+            Buffer out;
+            bool done = false;
+            fs.async_read(path, out, [&](const ErrorCode&, size_t) { done = true; });
+            run_until(io, done);
+            set_trace_observer(nullptr);
+        }
+
+        THEN("the events are written as a JSON array") {
+            auto content = fs.readFile(trace_path);
+            std::string json(content.begin(), content.end());
+            REQUIRE(json.front() == '[');
+            REQUIRE(json.find("\"ph\":\"b\"") != std::string::npos);
+            REQUIRE(json.find("\"ph\":\"X\"") != std::string::npos);
+            REQUIRE(json.find("\"ph\":\"e\"") != std::string::npos);
+            REQUIRE(json.find("\"name\":\"async_read\"") != std::string::npos);
+            REQUIRE(json.substr(json.size() - 3) == "\n]\n");
+        }
+    }
+
+    fs.removeDirectory(working_dir);
+}
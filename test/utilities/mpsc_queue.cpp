@@ -0,0 +1,107 @@
+#include <utilities/mpsc_queue.h>
+#include <thread>
+#include <vector>
+#include "catch.hpp"
+
+
+using namespace cynny::cynnypp::utilities;
+
+
+TEST_CASE("MpscQueue", "[mpsc_queue][utilities]") {
+    struct Item : MpscNode {
+        Item(unsigned int producer, unsigned int value) : producer{producer}, value{value} {}
+        unsigned int producer;
+        unsigned int value;
+    };
+
+    MpscQueue<Item> q;
+
+    SECTION("Empty queue") {
+        REQUIRE(q.pop() == nullptr);
+    }
+
+    SECTION("FIFO order with a single producer") {
+        for(unsigned int i = 0; i < 100; ++i)
+            q.push(std::unique_ptr<Item>(new Item(0, i)));
+        for(unsigned int i = 0; i < 100; ++i) {
+            auto item = q.pop();
+            REQUIRE(item != nullptr);
+            REQUIRE(item->value == i);
+        }
+        REQUIRE(q.pop() == nullptr);
+    }
+
+    SECTION("Multiple producers") {
+        const unsigned int n_producers = 4;
+        const unsigned int n_items = 10000;
+        std::vector<std::thread> producers;
+        for(unsigned int p = 0; p < n_producers; ++p) {
+            producers.emplace_back([&q, p, n_items]() {
+                for(unsigned int i = 0; i < n_items; ++i)
+                    q.push(std::unique_ptr<Item>(new Item(p, i)));
+            });
+        }
+
+        // the consumer sees the items of every producer in the order they were pushed
+        std::vector<unsigned int> next(n_producers, 0);
+        unsigned int popped = 0;
+        while(popped < n_producers * n_items) {
+            auto item = q.pop();
+            if(!item) {
+                std::this_thread::yield();
+                continue;
+            }
+            REQUIRE(item->value == next[item->producer]);
+            ++next[item->producer];
+            ++popped;
+        }
+        for(auto& t : producers)
+            t.join();
+        REQUIRE(q.pop() == nullptr);
+    }
+
+    SECTION("Elements pushed all together") {
+        std::thread producer([&q]() {
+            for(unsigned int i = 0; i < 1000; ++i)
+                q.push(std::unique_ptr<Item>(new Item(1, i)));
+        });
+        for(unsigned int b = 0; b < 100; ++b) {
+            std::vector<std::unique_ptr<Item>> batch;
+            for(unsigned int i = 0; i < 10; ++i)
+                batch.emplace_back(new Item(0, b * 10 + i));
+            q.push(std::move(batch));
+        }
+        q.push(std::vector<std::unique_ptr<Item>>{});
+
+        // the elements of a batch come out in order and without elements of other producers among them
+        unsigned int next = 0, next_other = 0, popped = 0;
+        unsigned int previous_producer = 1;
+        while(popped < 2000) {
+            auto item = q.pop();
+            if(!item) {
+                std::this_thread::yield();
+                continue;
+            }
+            if(item->producer == 0) {
+                REQUIRE(item->value == next);
+                if(next % 10 != 0)
+                    REQUIRE(previous_producer == 0);
+                ++next;
+            }
+            else {
+                REQUIRE(item->value == next_other);
+                REQUIRE(next % 10 == 0);
+                ++next_other;
+            }
+            previous_producer = item->producer;
+            ++popped;
+        }
+        producer.join();
+        REQUIRE(q.pop() == nullptr);
+    }
+
+    SECTION("Pending elements are destroyed with the queue") {
+        for(unsigned int i = 0; i < 10; ++i)
+            q.push(std::unique_ptr<Item>(new Item(0, i)));
+    }
+}
@@ -0,0 +1,79 @@
+#include <utilities/wakeup.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "catch.hpp"
+
+
+using namespace cynny::cynnypp::utilities;
+
+
+TEST_CASE("Wakeup", "[wakeup][utilities]") {
+    Wakeup wakeup;
+
+    SECTION("A notification before the wait is not lost") {
+        wakeup.notify();
+        wakeup.notify();
+        // returns at once, consuming both the notifications
+        wakeup.wait();
+        REQUIRE(wakeup.prepare_wait());
+        wakeup.finish_wait();
+    }
+
+    SECTION("Only a sleeping consumer has to be woken up") {
+        // running consumer: marked as notified, nothing to wake up
+        REQUIRE_FALSE(wakeup.signal());
+        REQUIRE_FALSE(wakeup.signal());
+        // the notification arrived meanwhile prevents the sleep
+        REQUIRE_FALSE(wakeup.prepare_wait());
+
+        REQUIRE(wakeup.prepare_wait());
+        REQUIRE(wakeup.signal());
+        REQUIRE_FALSE(wakeup.signal());
+        wakeup.finish_wait();
+        REQUIRE(wakeup.prepare_wait());
+        wakeup.finish_wait();
+    }
+
+    SECTION("A sleeping consumer is woken up") {
+        std::atomic<bool> woken{false};
+        std::thread consumer{[&wakeup, &woken]() {
+            wakeup.wait();
+            woken = true;
+        }};
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        wakeup.notify();
+        consumer.join();
+        REQUIRE(woken);
+    }
+
+    SECTION("Multiple producers") {
+        const unsigned int n_producers = 4;
+        const unsigned int n_items = 10000;
+        std::atomic<unsigned int> produced{0};
+        std::vector<std::thread> producers;
+        for(unsigned int p = 0; p < n_producers; ++p) {
+            producers.emplace_back([&wakeup, &produced, n_items]() {
+                for(unsigned int i = 0; i < n_items; ++i) {
+                    ++produced;
+                    wakeup.notify();
+                }
+            });
+        }
+
+        // the consumer sleeps whenever it has seen all the items produced so far, and is always woken up
+        // for the following ones
+        unsigned int consumed = 0;
+        while(consumed < n_producers * n_items) {
+            auto available = produced.load();
+            if(available == consumed) {
+                wakeup.wait();
+                continue;
+            }
+            consumed = available;
+        }
+        for(auto& t : producers)
+            t.join();
+        REQUIRE(consumed == n_producers * n_items);
+    }
+}